@@ -0,0 +1,124 @@
+#!/bin/bash
+# Offline load test rig for the ping engine
+#
+# Two network namespaces joined by a veth pair. The responder answers every address in the
+# benchmarking ranges (198.18.0.0/15, 2001:2::/48) itself, with echo replies and port unreachables,
+# so thousands of targets cost nothing to set up. netem on both ends adds delay, jitter and loss
+#
+# usage:
+#   ping-rig.sh up [--delay MS] [--jitter MS] [--loss PCT] [--no-echo] [--icmp-rate N]
+#   ping-rig.sh run [dropship-pingbench options]
+#   ping-rig.sh down
+#
+# --delay is one way, per side, so the rtt is twice it. --no-echo drops echo requests, for the tcp fallback.
+# --icmp-rate caps the responder's icmp errors per second like a real host does, unlimited by default
+#
+# Needs root. Build the bench with -DDROPSHIP_PINGBENCH=ON, or point BENCH at it
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_DIR="$(dirname "$SCRIPT_DIR")"
+BENCH="${BENCH:-$PROJECT_DIR/build/dropship-pingbench}"
+
+CLIENT="dropship-client"
+RESPONDER="dropship-responder"
+STATE="/run/dropship-ping-rig"
+
+rig_up() {
+    local delay=0 jitter=0 loss=0 echo=1 icmp_rate=0
+
+    while [ $# -gt 0 ]; do
+        case "$1" in
+            --delay) delay="$2"; shift 2 ;;
+            --jitter) jitter="$2"; shift 2 ;;
+            --loss) loss="$2"; shift 2 ;;
+            --no-echo) echo=0; shift ;;
+            --icmp-rate) icmp_rate="$2"; shift 2 ;;
+            *) echo "Unknown option: $1" >&2; exit 2 ;;
+        esac
+    done
+
+    rig_down 2>/dev/null || true
+
+    ip netns add "$CLIENT"
+    ip netns add "$RESPONDER"
+    ip link add rig0 netns "$CLIENT" type veth peer name rig1 netns "$RESPONDER"
+
+    ip -n "$CLIENT" link set lo up
+    ip -n "$CLIENT" link set rig0 up
+    ip -n "$CLIENT" addr add 10.255.255.1/30 dev rig0
+    ip -n "$CLIENT" addr add fd00:255::1/64 dev rig0 nodad
+    ip -n "$CLIENT" route add 198.18.0.0/15 via 10.255.255.2
+    ip -n "$CLIENT" route add 2001:2::/48 via fd00:255::2
+
+    ip -n "$RESPONDER" link set lo up
+    ip -n "$RESPONDER" link set rig1 up
+    ip -n "$RESPONDER" addr add 10.255.255.2/30 dev rig1
+    ip -n "$RESPONDER" addr add fd00:255::2/64 dev rig1 nodad
+
+    # Every address in the ranges is local, so the kernel answers for all of them
+    ip -n "$RESPONDER" route add local 198.18.0.0/15 dev lo table local
+    ip -n "$RESPONDER" -6 route add local 2001:2::/48 dev lo table local
+
+    # Unprivileged ping sockets in the client, like a desktop that allows them
+    ip netns exec "$CLIENT" sysctl -qw net.ipv4.ping_group_range="0 2147483647"
+
+    # Icmp errors are rate limited per host by default, which would look like loss
+    if [ "$icmp_rate" -gt 0 ]; then
+        ip netns exec "$RESPONDER" sysctl -qw net.ipv4.icmp_msgs_per_sec="$icmp_rate" net.ipv4.icmp_msgs_burst="$icmp_rate"
+    else
+        ip netns exec "$RESPONDER" sysctl -qw net.ipv4.icmp_ratelimit=0 net.ipv6.icmp.ratelimit=0 \
+            net.ipv4.icmp_msgs_per_sec=1000000 net.ipv4.icmp_msgs_burst=1000000
+    fi
+
+    if [ "$echo" -eq 0 ]; then
+        ip netns exec "$RESPONDER" sysctl -qw net.ipv4.icmp_echo_ignore_all=1 net.ipv6.icmp.echo_ignore_all=1
+    fi
+
+    # Both directions, so replies are delayed and lost like requests
+    local rtt=0
+    if [ "$delay" != 0 ] || [ "$jitter" != 0 ] || [ "$loss" != 0 ]; then
+        local netem="delay ${delay}ms ${jitter}ms loss ${loss}%"
+        if ip netns exec "$CLIENT" tc qdisc add dev rig0 root netem $netem limit 100000 \
+            && ip netns exec "$RESPONDER" tc qdisc add dev rig1 root netem $netem limit 100000; then
+            rtt=$(awk "BEGIN { print 2 * $delay }")
+        else
+            echo "Warning: netem is not available (sch_netem), running without delay, jitter or loss" >&2
+        fi
+    fi
+
+    echo "EXPECT_MS=$rtt" > "$STATE"
+
+    echo "Rig up, rtt ${rtt} ms. Targets: 198.18.0.1 and up, 2001:2::1 and up"
+}
+
+rig_run() {
+    if [ ! -f "$STATE" ]; then
+        echo "The rig is down, run: $0 up" >&2
+        exit 1
+    fi
+    source "$STATE"
+
+    if [ ! -x "$BENCH" ]; then
+        echo "No bench at $BENCH, build with -DDROPSHIP_PINGBENCH=ON or set BENCH" >&2
+        exit 1
+    fi
+
+    # netns exec remounts /sys, the syscall count needs tracefs back
+    ip netns exec "$CLIENT" sh -c 'mount -t tracefs nodev /sys/kernel/tracing 2>/dev/null; exec "$@"' sh \
+        "$BENCH" --expect-ms "$EXPECT_MS" "$@"
+}
+
+rig_down() {
+    ip netns del "$CLIENT" 2>/dev/null || true
+    ip netns del "$RESPONDER" 2>/dev/null || true
+    rm -f "$STATE"
+}
+
+case "$1" in
+    up) shift; rig_up "$@" ;;
+    run) shift; rig_run "$@" ;;
+    down) rig_down ;;
+    *) sed -n '2,16p' "$0" | sed 's/^# \{0,1\}//'; exit 2 ;;
+esac
@@ -2,17 +2,20 @@
 
 #include "Endpoint.h"
 
+extern std::unique_ptr<util::ping::PingService> g_ping_service;
+
 Endpoint2::Endpoint2(
 	std::string title,
 	std::string description,
 	std::string ip_ping,
+	uint16_t ping_port,
 	bool blocked
 ):
 
 	title(title),
 	description(description),
 	ip_ping(ip_ping.empty() ? std::nullopt : std::optional<std::string>{ ip_ping }),
-	ping(std::make_unique<std::optional<int>>(std::nullopt)),
+	ping_port(ping_port),
 	ping_ms_display(-1),
 
 	blocked(blocked),
@@ -37,24 +40,11 @@ void Endpoint2::start_pinging() {
 	try {
 		/* endpoint has no ip */
 		if (!this->ip_ping) return;
-		if (this->pinger.get() != nullptr) return;
-
-		/* ping */
-		this->pinger = std::make_unique<util::ping::Pinger>(this->ip_ping.value(), ping);
-		this->_ping_future = std::async(std::launch::async, [&]
-		{
-			try {
-				(*(this->pinger)).start();
-			}
-			catch (const std::exception& ex) {
-				// ...
-				std::println("{}", ex.what());
-			}
-			catch (...)
-			{
-				printf("error caught!");
-			}
-		});
+		if (this->_ping_target) return;
+		if (!g_ping_service) return;
+
+		/* ping, or connect if icmp is filtered or needs admin */
+		this->_ping_target = (*g_ping_service).add(this->ip_ping.value(), { .method = util::ping::Method::automatic, .port = this->ping_port });
 	}
 	catch (const std::exception& ex) {
 		// ...
@@ -67,10 +57,47 @@ void Endpoint2::start_pinging() {
 }
 
 void Endpoint2::stop_pinging() {
-	if (this->pinger.get() != nullptr) {
-		(*(this->pinger.get())).stop();
-		this->_ping_future.get();
-		(this->pinger).reset();
+	if (this->_ping_target) {
+		if (g_ping_service) (*g_ping_service).remove(this->_ping_target.value());
+		this->_ping_target.reset();
+	}
+}
+
+std::optional<int> Endpoint2::_getPing() {
+	if (!this->_ping_target || !g_ping_service) return std::nullopt;
+	return (*g_ping_service).getPing(this->_ping_target.value());
+}
+
+std::optional<util::ping::Statistics> Endpoint2::_getStatistics() {
+	if (!this->_ping_target || !g_ping_service) return std::nullopt;
+	return (*g_ping_service).getStatistics(this->_ping_target.value());
+}
+
+std::optional<util::ping::Method> Endpoint2::_getMethod() {
+	if (!this->_ping_target || !g_ping_service) return std::nullopt;
+	return (*g_ping_service).getMethod(this->_ping_target.value());
+}
+
+void Endpoint2::_updateTrace(bool shown) {
+	static const double keep_for = 30.0;
+
+	if (!shown) {
+		if (this->_trace && ImGui::GetTime() - this->_trace_last_shown > keep_for) this->_trace.reset();
+		return;
+	}
+
+	this->_trace_last_shown = ImGui::GetTime();
+
+	if (this->_trace || !this->ip_ping || !g_ping_service) return;
+
+	/* routers only answer what got to them, a tcp fallback can't be traced */
+	if (!(*g_ping_service).isAvailable(false)) return;
+
+	try {
+		this->_trace = std::make_unique<util::ping::Traceroute>(*g_ping_service, this->ip_ping.value());
+	}
+	catch (const std::exception& ex) {
+		std::println("{}", ex.what());
 	}
 }
 
@@ -10,7 +10,8 @@
 //#include <SDKDDKVer.h>
 // fix me ^
 
-#include "util/ping/Pinger.h"
+#include "util/ping/PingService.h"
+#include "util/ping/Traceroute.h"
 
 // TODO
 // 1. firewall->blockEndpoint()
@@ -33,6 +34,7 @@ class Endpoint2
 			std::string title,
 			std::string description,
 			std::string ip_ping = std::string(), // this will be converted to an std::optional<>, defaults to empty which will be converted to std::nullopt in endpoint.cpp
+			uint16_t ping_port = { 443 }, // tcp, if ip_ping drops icmp
 			bool blocked = { false }
 		);
 		~Endpoint2();
@@ -71,18 +73,31 @@ class Endpoint2
 
 		/* optionally, specify an ip for the ping display feature */
 		std::optional<std::string> ip_ping;
+		uint16_t ping_port;
 
 		/* is the endpoint blocked? and what's it's desired state? */
 		bool blocked;
 		bool blocked_desired;
 
-		//union {
-			std::unique_ptr<util::ping::Pinger> pinger;
-			std::future<void> _ping_future;
-		//};
+		/* registered with g_ping_service while pinging */
+		std::optional<util::ping::TargetId> _ping_target;
+
+		/* nullopt before the first reply, -1 on timeout */
+		std::optional<int> _getPing();
+
+		/* recent samples of the ipv4 target */
+		std::optional<util::ping::Statistics> _getStatistics();
+
+		/* icmp, or tcp once the ipv4 target stopped answering icmp */
+		std::optional<util::ping::Method> _getMethod();
+
+		/* path to ip_ping, traced while the details are shown */
+		std::unique_ptr<util::ping::Traceroute> _trace;
+		double _trace_last_shown { 0.0 };
+
+		/* start tracing if there is an icmp socket, stop once the details weren't looked at for a while */
+		void _updateTrace(bool shown);
 
-		//int ping;
-		std::unique_ptr<std::optional<int>> ping;
 		int ping_ms_display;
 
 		/* mirror the firewall state. this could change the "isBlocked()" value */
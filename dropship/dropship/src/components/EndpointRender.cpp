@@ -12,8 +12,10 @@ void Endpoint2::render(int i) {
 
 	//throw std::runtime_error("invalid runtime variable in array");
 
-	if (*(this->ping.get())) {
-		const auto ping_ms = (*(this->ping.get())).value();
+	const auto latest_ping = this->_getPing();
+
+	if (latest_ping) {
+		const auto ping_ms = latest_ping.value();
 		if (this->ping_ms_display != ping_ms)
 		{
 			static const float min_delay = 9.0f;
@@ -118,13 +120,13 @@ void Endpoint2::render(int i) {
 	// w_list->AddText(font_subtitle, 24, pos, this->blocked ? color_secondary : color_text_secondary, this->description.c_str());
 	w_list->AddText(font_subtitle, 24, pos, this->blocked ? color_secondary : color_text_secondary, this->blocked ? (this->description + " (blocked)").c_str() : this->description.c_str());
 
-	if ((*(this->ping))) {
+	if (latest_ping) {
 
 		// display 3 / (icon wifi)
 		auto icon = _get_texture("icon_wifi");
 		static ImVec2 frame = ImVec2(26, 26);
 
-		const auto ping = (*(this->ping.get())).value();
+		const auto ping = latest_ping.value();
 
 		if (ping > 90)
 			icon = _get_texture("icon_wifi_poor");
@@ -146,6 +148,46 @@ void Endpoint2::render(int i) {
 		}
 	}
 
+	// details of the last 32 pings, and the path there
+	this->_updateTrace(hovered);
+
+	if (hovered) {
+		const auto statistics = this->_getStatistics();
+		if (statistics && statistics->valid() && ImGui::BeginItemTooltip()) {
+			ImGui::Text("min %.0f  avg %.0f  p50 %.0f  p95 %.0f ms", statistics->min, statistics->mean, statistics->p50, statistics->p95);
+			ImGui::Text("jitter %.1f ms  loss %.0f%%", statistics->jitter, statistics->loss() * 100.0f);
+
+			if (statistics->error)
+				ImGui::TextDisabled("+/- %.2f ms", statistics->error.value());
+			else
+				ImGui::TextDisabled("timed by the app, not the kernel");
+
+			if (this->_getMethod() == util::ping::Method::tcp)
+				ImGui::TextDisabled("no icmp replies, timing tcp connects to port %u", this->ping_port);
+
+			if (this->_trace) {
+				auto hops = this->_trace->getHops();
+
+				/* nothing past the furthest hop that answered yet */
+				while (!hops.empty() && !hops.back().address) hops.pop_back();
+
+				ImGui::Separator();
+
+				for (auto& hop : hops) {
+					if (hop.statistics.valid())
+						ImGui::Text("%2u  %-15s  %6.1f ms  loss %.0f%%", hop.ttl, hop.address.value_or("*").c_str(), hop.statistics.p50, hop.statistics.loss() * 100.0f);
+					else
+						ImGui::TextDisabled("%2u  *", hop.ttl);
+				}
+
+				if (!this->_trace->isComplete())
+					ImGui::TextDisabled("tracing...");
+			}
+
+			ImGui::EndTooltip();
+		}
+	}
+
 	/* context menu*/
 	/* {
 		if (ImGui::BeginPopupContextItem()) // <-- use last item id as popup id
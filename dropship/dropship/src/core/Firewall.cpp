@@ -1,6 +1,9 @@
 #include "pch.h"
 
 #include "Firewall.h"
+#include "util/ping/PingService.h"
+
+extern std::unique_ptr<util::ping::PingService> g_ping_service;
 
 Firewall::Firewall()
 {
@@ -51,8 +54,15 @@ void Firewall::_queryNetworkStatus() {
 #endif
 
 	//this->_network_information = std::make_optional<util::win_network::NetworkInformation>(util::win_network::queryNetwork());
+	const auto previous = this->_network_information;
 	this->_network_information = util::win_network::queryNetwork();
 
+	/* a new network or a vpn, latency over the old one says nothing about it */
+	if (g_ping_service && previous != this->_network_information)
+	{
+		(*g_ping_service).reprobe();
+	}
+
 }
 
 void Firewall::tryWriteSettingsToFirewall(std::string data, std::string block, std::optional<std::filesystem::path> tunneling_path) {
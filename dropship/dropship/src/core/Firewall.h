@@ -37,7 +37,7 @@ class Firewall
 
 		bool _coInitilizeSuccess;
 		//std::optional<util::win_network::NetworkInformation> _network_information; // note; optional not needed, takes <10ms
-		util::win_network::NetworkInformation _network_information;
+		util::win_network::NetworkInformation _network_information {};
 		double _network_information_updated_frametime { 0. };
 
 	private:
@@ -0,0 +1,191 @@
+#include "GameLatency.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace core::latency {
+
+	GameLatency::GameLatency(std::optional<float> expected_ms)
+	{
+		if (expected_ms && expected_ms.value() > 0.0f) this->_running_ms = expected_ms.value();
+	}
+
+	void GameLatency::observe(int64_t timestamp_ns, bool outgoing)
+	{
+		if (this->_published_ns == 0) this->_published_ns = timestamp_ns;
+
+		this->_expire(timestamp_ns);
+
+		if (outgoing)
+		{
+			this->_sent++;
+
+			if (this->_last_sent_ns != 0)
+			{
+				const float gap_ms = (timestamp_ns - this->_last_sent_ns) / 1e6f;
+				this->_interval_ms = this->_interval_ms < 0.0f ? gap_ms : this->_interval_ms + (gap_ms - this->_interval_ms) / 8.0f;
+			}
+			this->_last_sent_ns = timestamp_ns;
+
+			/* full, the oldest will never be answered in time anyway */
+			if (this->_pending_count == __pending)
+			{
+				this->_pending_first = (this->_pending_first + 1) % __pending;
+				this->_pending_count--;
+				this->_addSample(-1.0f);
+			}
+
+			this->_pending[(this->_pending_first + this->_pending_count) % __pending] = timestamp_ns;
+			this->_pending_count++;
+		}
+		else
+		{
+			this->_received++;
+
+			/* nothing asked, ex. the server starting the flow */
+			if (this->_pending_count > 0)
+			{
+				const float oldest_ms = (timestamp_ns - this->_pending[this->_pending_first]) / 1e6f;
+				float rtt_ms = oldest_ms;
+				bool answered = true;
+
+				if (this->_running_ms >= 0.0f)
+				{
+					auto distance = [this](float ms) { return std::fabs(ms - this->_running_ms); };
+
+					/* an answer to a request sent before the oldest one we have. can't tell until the interval is known */
+					if (this->_interval_ms <= 0.0f || distance(oldest_ms + this->_interval_ms) < distance(oldest_ms))
+					{
+						answered = false;
+					}
+
+					/* the oldest one's answer was lost */
+					if (answered && this->_pending_count > 1)
+					{
+						const float next_ms = (timestamp_ns - this->_pending[(this->_pending_first + 1) % __pending]) / 1e6f;
+						if (distance(next_ms) < distance(oldest_ms))
+						{
+							this->_pending_first = (this->_pending_first + 1) % __pending;
+							this->_pending_count--;
+							this->_addSample(-1.0f);
+							rtt_ms = next_ms;
+						}
+					}
+				}
+
+				if (answered)
+				{
+					this->_pending_first = (this->_pending_first + 1) % __pending;
+					this->_pending_count--;
+
+					this->_running_ms = this->_running_ms < 0.0f ? rtt_ms : this->_running_ms + (rtt_ms - this->_running_ms) / 8.0f;
+					this->_addSample(rtt_ms);
+				}
+			}
+		}
+
+		if (this->_since_publish >= __publish_every) this->_publish(timestamp_ns);
+	}
+
+	void GameLatency::_expire(int64_t now_ns)
+	{
+		while (this->_pending_count > 0 && now_ns - this->_pending[this->_pending_first] > __timeout_ns)
+		{
+			this->_pending_first = (this->_pending_first + 1) % __pending;
+			this->_pending_count--;
+			this->_addSample(-1.0f);
+		}
+	}
+
+	void GameLatency::_addSample(float rtt_ms)
+	{
+		this->_samples[this->_next] = rtt_ms;
+		this->_next = (this->_next + 1) % __window;
+		this->_count = std::min(this->_count + 1, __window);
+		this->_since_publish++;
+	}
+
+	void GameLatency::_publish(int64_t now_ns)
+	{
+		GameEstimate estimate;
+		estimate.updated_ns = now_ns;
+
+		const float seconds = (now_ns - this->_published_ns) / 1e9f;
+		if (seconds > 0.0f)
+		{
+			estimate.sent_rate = this->_sent / seconds;
+			estimate.received_rate = this->_received / seconds;
+		}
+
+		estimate.paired = this->_sent > 0 && std::fabs(static_cast<float>(this->_received) / this->_sent - 1.0f) <= __pairing_tolerance;
+
+		this->_sent = 0;
+		this->_received = 0;
+		this->_published_ns = now_ns;
+		this->_since_publish = 0;
+
+		if (!estimate.paired)
+		{
+			this->_estimate.store(estimate);
+			return;
+		}
+
+		/* oldest first */
+		const size_t first = (this->_next + __window - this->_count) % __window;
+
+		std::array<float, __window> replies;
+		size_t count = 0;
+		float sum = 0.0f;
+		float jitter_sum = 0.0f;
+		size_t jitter_count = 0;
+		float previous = -1.0f;
+
+		auto& statistics = estimate.statistics;
+		statistics.samples = static_cast<uint32_t>(this->_count);
+
+		for (size_t i = 0; i < this->_count; i++)
+		{
+			const float sample = this->_samples[(first + i) % __window];
+			if (sample < 0.0f)
+			{
+				statistics.lost++;
+				continue;
+			}
+
+			replies[count++] = sample;
+			sum += sample;
+
+			if (previous >= 0.0f)
+			{
+				jitter_sum += std::fabs(sample - previous);
+				jitter_count++;
+			}
+			previous = sample;
+		}
+
+		statistics.last = this->_samples[(this->_next + __window - 1) % __window];
+
+		if (count > 0)
+		{
+			statistics.mean = sum / count;
+			statistics.jitter = jitter_count ? jitter_sum / jitter_count : 0.0f;
+			statistics.min = *std::min_element(replies.begin(), replies.begin() + count);
+
+			/* kernel timestamps on both ends, the wait for the thread to read them doesn't count */
+			statistics.error = 0.0f;
+
+			/* nearest rank */
+			auto percentile = [&](float p)
+			{
+				const size_t rank = std::min(count - 1, static_cast<size_t>(std::ceil(p * count)) - 1);
+				std::nth_element(replies.begin(), replies.begin() + rank, replies.begin() + count);
+				return replies[rank];
+			};
+
+			statistics.p50 = percentile(0.50f);
+			statistics.p95 = percentile(0.95f);
+		}
+
+		this->_estimate.store(estimate);
+	}
+}
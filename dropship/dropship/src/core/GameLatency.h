@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "util/ping/Statistics.h"
+
+/* no pch, shared by the windows and linux builds */
+
+namespace core::latency {
+
+	/* what a game flow looks like from its packet timing */
+	struct GameEstimate {
+		/* in game rtt and loss of the flow. invalid if it doesn't pair up */
+		util::ping::Statistics statistics;
+
+		/* packets per second each way, over the window */
+		float sent_rate { 0.0f };
+		float received_rate { 0.0f };
+
+		/* the server answers what the client sends one for one, so the timing says something */
+		bool paired { false };
+
+		/* capture time of the last packet, unix ns. 0 if none */
+		int64_t updated_ns { 0 };
+	};
+
+	/*
+		passive latency of the game's own traffic, from when its packets left and arrived
+		each packet from the server is taken as the answer to one the client sent, and from timing alone any request
+		a send interval or two earlier would do as well. the one that gives an rtt closest to the running estimate wins:
+		the oldest unanswered, the one after it if the oldest's answer was lost, or none if it answers one sent before
+		the capture started. the running estimate starts from the active ping, so it lines up mid flow
+		a flow where the server sends at its own rate has no pairs to find, it's reported as not paired
+		one writer feeds packets in timestamp order, readers on any thread
+	*/
+	class GameLatency
+	{
+		/* consts */
+		private:
+			/* requests in flight. more than this and the oldest is lost */
+			static constexpr size_t __pending { 64 };
+
+			/* a request not answered within this is lost */
+			static constexpr int64_t __timeout_ns { 1'000'000'000 };
+
+			/* samples the statistics are over, a few seconds of a game */
+			static constexpr size_t __window { 256 };
+
+			/* the estimate is published every this many samples */
+			static constexpr size_t __publish_every { 16 };
+
+			/* received over sent further than this from 1 and the flow isn't one for one */
+			static constexpr float __pairing_tolerance { 0.25f };
+
+		public:
+			/* expected_ms is the rtt to the server by active probes, if there is one */
+			GameLatency(std::optional<float> expected_ms);
+
+			/* outgoing is from the client to the server. timestamps from the capture, not from when it's read */
+			void observe(int64_t timestamp_ns, bool outgoing);
+
+			GameEstimate getEstimate() const { return this->_estimate.load(); }
+
+		private:
+			/* requests older than the timeout are lost */
+			void _expire(int64_t now_ns);
+
+			/* negative for lost */
+			void _addSample(float rtt_ms);
+			void _publish(int64_t now_ns);
+
+			/* negative for lost */
+			std::array<float, __window> _samples {};
+			size_t _next { 0 };
+			size_t _count { 0 };
+			size_t _since_publish { 0 };
+
+			/* sent times of requests in flight, oldest first from _pending_first */
+			std::array<int64_t, __pending> _pending {};
+			size_t _pending_first { 0 };
+			size_t _pending_count { 0 };
+
+			/* packets each way since the last publish */
+			uint32_t _sent { 0 };
+			uint32_t _received { 0 };
+			int64_t _published_ns { 0 };
+
+			/* running rtt, negative until the first pair */
+			float _running_ms { -1.0f };
+
+			/* running gap between requests, negative until the second */
+			float _interval_ms { -1.0f };
+			int64_t _last_sent_ns { 0 };
+
+			util::ping::Seqlock<GameEstimate> _estimate;
+	};
+}
@@ -0,0 +1,241 @@
+#include "LatencyHistory.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+namespace core::latency {
+
+	namespace {
+		/* "Dhistory" */
+		constexpr uint64_t MAGIC { 0x79726f7473696844 };
+		constexpr uint32_t VERSION { 1 };
+
+		/* records are copied a word at a time, so a reader racing the writer never tears one silently */
+		constexpr size_t RECORD_WORDS { sizeof(Record) / sizeof(uint64_t) };
+		using Words = std::array<uint64_t, RECORD_WORDS>;
+		static_assert(sizeof(Record) == sizeof(Words) && std::is_trivially_copyable_v<Record>);
+	}
+
+	History::History(const std::filesystem::path& path)
+	{
+		const size_t size = sizeof(Header) + __capacity * sizeof(Slot);
+		bool fresh = false;
+
+#if defined(_WIN32)
+		/* no sharing for writes, a second instance gets nothing */
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("can't open " + path.string());
+		this->_file = file;
+
+		LARGE_INTEGER current;
+		if (!GetFileSizeEx(file, &current) || static_cast<size_t>(current.QuadPart) != size)
+		{
+			/* new, or another layout. start over, zeroed */
+			LARGE_INTEGER zero {};
+			LARGE_INTEGER wanted;
+			wanted.QuadPart = static_cast<LONGLONG>(size);
+
+			if (!SetFilePointerEx(file, zero, nullptr, FILE_BEGIN) || !SetEndOfFile(file)
+				|| !SetFilePointerEx(file, wanted, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+			{
+				this->_unmap();
+				throw std::runtime_error("can't size " + path.string());
+			}
+			fresh = true;
+		}
+
+		void* data = nullptr;
+		this->_mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+		if (this->_mapping) data = MapViewOfFile(this->_mapping, FILE_MAP_WRITE, 0, 0, size);
+		if (!data)
+		{
+			this->_unmap();
+			throw std::runtime_error("can't map " + path.string());
+		}
+#else
+		const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0) throw std::runtime_error("can't open " + path.string());
+		this->_fd = fd;
+
+		/* released when the fd closes, even on a crash */
+		if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+		{
+			this->_unmap();
+			throw std::runtime_error("in use " + path.string());
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != size)
+		{
+			/* new, or another layout. start over, zeroed */
+			if (ftruncate(fd, 0) != 0 || ftruncate(fd, static_cast<off_t>(size)) != 0)
+			{
+				this->_unmap();
+				throw std::runtime_error("can't size " + path.string());
+			}
+			fresh = true;
+		}
+
+		void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			this->_unmap();
+			throw std::runtime_error("can't map " + path.string());
+		}
+#endif
+
+		this->_size = size;
+		this->_header = static_cast<Header*>(data);
+		this->_slots = reinterpret_cast<Slot*>(static_cast<uint8_t*>(data) + sizeof(Header));
+
+		const auto& header = *this->_header;
+		if (fresh || header.magic != MAGIC || header.version != VERSION || header.record_size != sizeof(Record) || header.capacity != __capacity)
+		{
+			std::memset(data, 0, size);
+
+			this->_header->magic = MAGIC;
+			this->_header->version = VERSION;
+			this->_header->record_size = sizeof(Record);
+			this->_header->capacity = __capacity;
+		}
+	}
+
+	History::~History()
+	{
+		this->_unmap();
+	}
+
+	void History::_unmap()
+	{
+#if defined(_WIN32)
+		if (this->_header) UnmapViewOfFile(this->_header);
+		if (this->_mapping) CloseHandle(this->_mapping);
+		if (this->_file) CloseHandle(this->_file);
+		this->_mapping = nullptr;
+		this->_file = nullptr;
+#else
+		if (this->_header) munmap(this->_header, this->_size);
+		if (this->_fd >= 0) close(this->_fd);
+		this->_fd = -1;
+#endif
+		this->_header = nullptr;
+		this->_slots = nullptr;
+	}
+
+	void History::append(Record record)
+	{
+		std::atomic_ref<uint64_t> head(this->_header->head);
+		const uint64_t index = head.load(std::memory_order_relaxed);
+
+		/* we're the only writer, the previous record can't change under us */
+		if (index > 0)
+		{
+			Words previous;
+			std::memcpy(previous.data(), this->_slots[(index - 1) % __capacity].record, sizeof(Words));
+			record.time = std::max(record.time, std::bit_cast<Record>(previous).time);
+		}
+
+		auto& slot = this->_slots[index % __capacity];
+		std::atomic_ref<uint64_t> sequence(slot.sequence);
+
+		/* readers of the record being replaced see it go */
+		sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		const auto words = std::bit_cast<Words>(record);
+
+		for (size_t i = 0; i < RECORD_WORDS; i++)
+		{
+			std::atomic_ref<uint64_t>(slot.record[i]).store(words[i], std::memory_order_relaxed);
+		}
+
+		sequence.store(index + 1, std::memory_order_release);
+		head.store(index + 1, std::memory_order_release);
+	}
+
+	std::optional<Record> History::_read(uint64_t index) const
+	{
+		auto& slot = this->_slots[index % __capacity];
+		std::atomic_ref<uint64_t> sequence(slot.sequence);
+
+		if (sequence.load(std::memory_order_acquire) != index + 1) return std::nullopt;
+
+		Words words;
+		for (size_t i = 0; i < RECORD_WORDS; i++)
+		{
+			words[i] = std::atomic_ref<uint64_t>(slot.record[i]).load(std::memory_order_relaxed);
+		}
+
+		/* lapped while we copied */
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (sequence.load(std::memory_order_relaxed) != index + 1) return std::nullopt;
+
+		return std::bit_cast<Record>(words);
+	}
+
+	std::optional<Record> History::getLast() const
+	{
+		const uint64_t head = this->getCount();
+		if (head == 0) return std::nullopt;
+
+		return this->_read(head - 1);
+	}
+
+	uint64_t History::getCount() const
+	{
+		return std::atomic_ref<uint64_t>(this->_header->head).load(std::memory_order_acquire);
+	}
+
+	std::vector<Record> History::query(int64_t since) const
+	{
+		const uint64_t head = this->getCount();
+		const uint64_t oldest = head > __capacity ? head - __capacity : 0;
+
+		/* the first record at or after since. one being overwritten is about to be the oldest, so it counts as before */
+		uint64_t low = oldest;
+		uint64_t high = head;
+
+		while (low < high)
+		{
+			const uint64_t middle = low + (high - low) / 2;
+			const auto record = this->_read(middle);
+
+			if (!record || record->time < since)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+
+		std::vector<Record> records;
+		records.reserve(static_cast<size_t>(head - low));
+
+		for (uint64_t i = low; i < head; i++)
+		{
+			const auto record = this->_read(i);
+			if (record) records.push_back(record.value());
+		}
+
+		return records;
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+/* no pch, shared by the windows and linux builds */
+
+namespace core::latency {
+
+	/* a region's estimate at one point in time. fixed size, it's stored as is */
+	struct Record {
+		/* unix seconds */
+		int64_t time { 0 };
+
+		float last { -1.0f };
+		float p50 { 0.0f };
+		float p95 { 0.0f };
+		float jitter { 0.0f };
+		float spread { 0.0f };
+
+		uint16_t responders { 0 };
+		uint16_t candidates { 0 };
+	};
+
+	/*
+		a region's recent estimates, in a ring of fixed size records in a mapped file
+		the newest record is there on the next launch, and a query is a binary search over the mapping.
+		one writer appends without locks, readers on other threads retry a record the writer is lapping.
+		only one process opens a file, throws std::runtime_error if it's taken or can't be mapped
+	*/
+	class History
+	{
+		/* consts */
+		public:
+			/* a little over a week at one record every 30s */
+			static constexpr uint32_t __capacity { 1 << 15 };
+
+		public:
+			History(const std::filesystem::path& path);
+			~History();
+
+			History(const History&) = delete;
+			History& operator=(const History&) = delete;
+
+			/* single writer. a time earlier than the last record's is raised to it, so the ring stays sorted */
+			void append(Record record);
+
+			/* nullopt if nothing was ever appended */
+			std::optional<Record> getLast() const;
+
+			/* records from since on, oldest first */
+			std::vector<Record> query(int64_t since) const;
+
+			/* records written since the file was created, including the ones the ring dropped */
+			uint64_t getCount() const;
+
+		private:
+			struct Header {
+				uint64_t magic;
+				uint32_t version;
+				uint32_t record_size;
+				uint32_t capacity;
+				uint32_t reserved;
+
+				/* next record to write. only grows */
+				uint64_t head;
+			};
+
+			/* a record and the head it was written at + 1. 0 while it's being written */
+			struct Slot {
+				uint64_t sequence;
+				uint64_t record[sizeof(Record) / sizeof(uint64_t)];
+			};
+
+			/* the record at index, if the ring still holds it and it isn't being written */
+			std::optional<Record> _read(uint64_t index) const;
+
+			/* safe to call more than once */
+			void _unmap();
+
+			Header* _header { nullptr };
+			Slot* _slots { nullptr };
+			size_t _size { 0 };
+
+#if defined(_WIN32)
+			void* _file { nullptr };
+			void* _mapping { nullptr };
+#else
+			int _fd { -1 };
+#endif
+	};
+}
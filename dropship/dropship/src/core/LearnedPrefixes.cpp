@@ -0,0 +1,327 @@
+#include "LearnedPrefixes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+namespace core::learned {
+
+	namespace {
+		/* never game servers */
+		const auto __local_prefixes = util::net::parsePrefixes("0.0.0.0/8,10.0.0.0/8,100.64.0.0/10,127.0.0.0/8,169.254.0.0/16,172.16.0.0/12,192.168.0.0/16,224.0.0.0/3,::/127,fc00::/7,fe80::/10,ff00::/8");
+
+		bool isLocal(const util::net::Address& a)
+		{
+			for (auto& p : __local_prefixes)
+			{
+				if (p.contains(a)) return true;
+			}
+			return false;
+		}
+
+		int64_t now()
+		{
+			return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+	}
+
+	void to_json(json& j, const LearnedPrefix& p)
+	{
+		j = json {
+			{ "cidr", p.cidr },
+			{ "region", p.region },
+			{ "hits", p.hits },
+			{ "first_seen", p.first_seen },
+			{ "last_seen", p.last_seen },
+			{ "merged", p.merged },
+		};
+	}
+
+	void from_json(const json& j, LearnedPrefix& p)
+	{
+		j.at("cidr").get_to(p.cidr);
+		if (j.contains("region")) j.at("region").get_to(p.region);
+		if (j.contains("hits")) j.at("hits").get_to(p.hits);
+		if (j.contains("first_seen")) j.at("first_seen").get_to(p.first_seen);
+		if (j.contains("last_seen")) j.at("last_seen").get_to(p.last_seen);
+		if (j.contains("merged")) j.at("merged").get_to(p.merged);
+	}
+
+
+	LearnedPrefixes::LearnedPrefixes(std::filesystem::path storage_path) :
+		_storage_path(storage_path)
+	{
+		for (auto& [title, e] : dropship::settings::ow2_endpoints)
+		{
+			for (auto& s : e.blocked_servers)
+			{
+				if (dropship::settings::ow2_servers.contains(s))
+				{
+					this->_catalog.add(title, dropship::settings::ow2_servers.at(s).block);
+				}
+			}
+		}
+
+		this->tryLoadFromStorage();
+	}
+
+	LearnedPrefixes::~LearnedPrefixes()
+	{
+		bool dirty;
+		{
+			std::lock_guard lock(this->_prefixes_mutex);
+			dirty = this->_dirty;
+		}
+
+		if (dirty) this->tryWriteToStorage();
+	}
+
+	std::optional<std::string> LearnedPrefixes::classify(const std::string& address)
+	{
+		auto a = util::net::Address::parse(address);
+		if (!a) return std::nullopt;
+
+		if (auto region = this->_catalog.classify(a.value()))
+		{
+			return *region;
+		}
+
+		std::lock_guard lock(this->_prefixes_mutex);
+		for (auto& [prefix, learned] : this->_prefixes)
+		{
+			if (prefix.contains(a.value()) && !learned.region.empty())
+			{
+				return learned.region;
+			}
+		}
+
+		return std::nullopt;
+	}
+
+	bool LearnedPrefixes::observe(const std::string& address, const std::string& region)
+	{
+		auto a = util::net::Address::parse(address);
+		if (!a || isLocal(a.value())) return false;
+
+		if (this->_catalog.classify(a.value())) return false;
+
+		{
+			std::lock_guard lock(this->_prefixes_mutex);
+
+			const bool seen = !this->_seen.insert(address).second;
+
+			auto known = std::find_if(this->_prefixes.begin(), this->_prefixes.end(), [&](const auto& p) { return p.first.contains(a.value()); });
+			if (known != this->_prefixes.end())
+			{
+				auto& learned = known->second;
+				learned.last_seen = now();
+
+				/* first time we know where it was seen */
+				const bool located = learned.region.empty() && !region.empty();
+				if (located) learned.region = region;
+
+				if (!seen) learned.hits++;
+
+				/* a rescan of the same socket waits for the next write */
+				this->_dirty = true;
+				if (seen && !located) return true;
+
+				if (located) this->_aggregate(known->first);
+			}
+			else
+			{
+				const auto prefix = util::net::Prefix::of(a.value(), a.value().v4() ? __v4_observe_length : __v6_observe_length);
+
+				this->_prefixes[prefix] = {
+					.cidr = prefix.toString(),
+					.region = region,
+					.hits = 1,
+					.first_seen = now(),
+					.last_seen = now(),
+				};
+
+				this->_aggregate(prefix);
+			}
+		}
+
+		this->tryWriteToStorage();
+
+		return true;
+	}
+
+	void LearnedPrefixes::_aggregate(util::net::Prefix prefix)
+	{
+		while (true)
+		{
+			const auto min_length = prefix.address.v4() ? __v4_aggregate_length : __v6_aggregate_length;
+			if (prefix.familyLength() <= min_length) return;
+
+			auto a = this->_prefixes.find(prefix);
+			auto b = this->_prefixes.find(prefix.sibling());
+			if (a == this->_prefixes.end() || b == this->_prefixes.end()) return;
+
+			/* only merge ranges seen in the same place */
+			if (a->second.region != b->second.region || a->second.merged != b->second.merged) return;
+
+			const auto parent = prefix.truncated(prefix.familyLength() - 1);
+
+			LearnedPrefix merged = a->second;
+			merged.cidr = parent.toString();
+			merged.hits += b->second.hits;
+			merged.first_seen = std::min(a->second.first_seen, b->second.first_seen);
+			merged.last_seen = std::max(a->second.last_seen, b->second.last_seen);
+
+			this->_prefixes.erase(a);
+			this->_prefixes.erase(b);
+			this->_prefixes[parent] = merged;
+
+			prefix = parent;
+		}
+	}
+
+	std::vector<LearnedPrefix> LearnedPrefixes::getPrefixes()
+	{
+		std::lock_guard lock(this->_prefixes_mutex);
+
+		std::vector<LearnedPrefix> result;
+		for (auto& [prefix, learned] : this->_prefixes)
+		{
+			result.push_back(learned);
+		}
+		return result;
+	}
+
+	void LearnedPrefixes::setMerged(const std::string& cidr, bool merged)
+	{
+		auto prefix = util::net::Prefix::parse(cidr);
+		if (!prefix) return;
+
+		{
+			std::lock_guard lock(this->_prefixes_mutex);
+
+			auto it = this->_prefixes.find(prefix.value());
+			if (it == this->_prefixes.end() || it->second.merged == merged) return;
+
+			it->second.merged = merged;
+			this->_aggregate(prefix.value());
+		}
+
+		this->tryWriteToStorage();
+	}
+
+	void LearnedPrefixes::setRegion(const std::string& cidr, const std::string& region)
+	{
+		auto prefix = util::net::Prefix::parse(cidr);
+		if (!prefix) return;
+
+		{
+			std::lock_guard lock(this->_prefixes_mutex);
+
+			auto it = this->_prefixes.find(prefix.value());
+			if (it == this->_prefixes.end() || it->second.region == region) return;
+
+			it->second.region = region;
+			this->_aggregate(prefix.value());
+		}
+
+		this->tryWriteToStorage();
+	}
+
+	void LearnedPrefixes::forget(const std::string& cidr)
+	{
+		auto prefix = util::net::Prefix::parse(cidr);
+		if (!prefix) return;
+
+		{
+			std::lock_guard lock(this->_prefixes_mutex);
+			if (this->_prefixes.erase(prefix.value()) == 0) return;
+		}
+
+		this->tryWriteToStorage();
+	}
+
+	std::vector<std::string> LearnedPrefixes::getBlockedAddresses(const std::set<std::string>& blocked_endpoints)
+	{
+		std::lock_guard lock(this->_prefixes_mutex);
+
+		std::vector<std::string> result;
+		for (auto& [prefix, learned] : this->_prefixes)
+		{
+			if (learned.merged && blocked_endpoints.contains(learned.region))
+			{
+				result.push_back(learned.cidr);
+			}
+		}
+		return result;
+	}
+
+	std::vector<std::string> LearnedPrefixes::getAllowedAddresses(const std::set<std::string>& blocked_endpoints)
+	{
+		std::lock_guard lock(this->_prefixes_mutex);
+
+		std::vector<std::string> result;
+		for (auto& [prefix, learned] : this->_prefixes)
+		{
+			if (learned.merged && !blocked_endpoints.contains(learned.region))
+			{
+				result.push_back(learned.cidr);
+			}
+		}
+		return result;
+	}
+
+	void LearnedPrefixes::tryLoadFromStorage()
+	{
+		std::ifstream file(this->_storage_path);
+		if (!file) return;
+
+		try {
+			std::vector<LearnedPrefix> loaded = json::parse(file);
+
+			std::lock_guard lock(this->_prefixes_mutex);
+			for (auto& learned : loaded)
+			{
+				if (auto prefix = util::net::Prefix::parse(learned.cidr))
+				{
+					learned.cidr = prefix.value().toString();
+					this->_prefixes[prefix.value()] = learned;
+				}
+			}
+		}
+		catch (json::exception& e) {
+			std::cerr << "learned prefixes: " << e.what() << std::endl;
+		}
+	}
+
+	void LearnedPrefixes::tryWriteToStorage()
+	{
+		std::string data;
+		{
+			std::lock_guard lock(this->_prefixes_mutex);
+
+			json j = json::array();
+			for (auto& [prefix, learned] : this->_prefixes)
+			{
+				j.push_back(learned);
+			}
+			data = j.dump(4);
+
+			this->_dirty = false;
+		}
+
+		/* write then rename so a crash never leaves half a file */
+		std::error_code ec;
+		std::filesystem::create_directories(this->_storage_path.parent_path(), ec);
+
+		auto tmp = this->_storage_path;
+		tmp += ".tmp";
+
+		{
+			std::ofstream file(tmp, std::ios::trunc);
+			if (!(file << data)) return;
+		}
+
+		std::filesystem::rename(tmp, this->_storage_path, ec);
+	}
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "json/json.hpp"
+
+#include "core/Catalog.h"
+#include "util/net/cidr.h"
+
+/* no pch, shared by the windows and linux builds */
+
+namespace core::learned {
+
+	using json = nlohmann::json;
+
+	/* a game server range that is not in the catalog */
+	struct LearnedPrefix {
+		std::string cidr;
+
+		/* endpoint title the game was on when this was seen. empty if unknown */
+		std::string region;
+
+		/* addresses of the range the game used, each counted once per run */
+		uint32_t hits { 0 };
+		int64_t first_seen { 0 };
+		int64_t last_seen { 0 };
+
+		/* accepted by the user, blocked together with its region */
+		bool merged { false };
+	};
+
+	void to_json(json& j, const LearnedPrefix& p);
+	void from_json(const json& j, LearnedPrefix& p);
+
+	/*
+		watches the remote addresses of the game and keeps the ones the catalog doesn't cover
+		ex. settings.h "started connecting to 64.224.0.0/21" would have shown up here as 64.224.0.0/24
+	*/
+	class LearnedPrefixes
+	{
+		/* consts */
+		private:
+			/* single addresses are recorded at these lengths */
+			static constexpr int __v4_observe_length { 24 };
+			static constexpr int __v6_observe_length { 48 };
+
+			/* siblings are merged up to, but not past, these lengths */
+			static constexpr int __v4_aggregate_length { 20 };
+			static constexpr int __v6_aggregate_length { 32 };
+
+		public:
+			LearnedPrefixes(std::filesystem::path storage_path);
+			~LearnedPrefixes();
+
+			/* endpoint title for a catalog or learned address */
+			std::optional<std::string> classify(const std::string& address);
+
+			/*
+				record a remote address of the game. region is the endpoint the game is on, if known
+				returns true if the address is outside the catalog. the same address seen again only moves last_seen,
+				which is saved with the next change or on destruction
+			*/
+			bool observe(const std::string& address, const std::string& region);
+
+			std::vector<LearnedPrefix> getPrefixes();
+
+			/* accept or reject a learned prefix for blocking */
+			void setMerged(const std::string& cidr, bool merged);
+			void forget(const std::string& cidr);
+
+			/* the region of a prefix seen before the game's region was known, ex. one inferred from its latency */
+			void setRegion(const std::string& cidr, const std::string& region);
+
+			/* merged prefixes learned in any of the blocked endpoints. added to the block list */
+			std::vector<std::string> getBlockedAddresses(const std::set<std::string>& blocked_endpoints);
+
+			/* merged prefixes learned in the other endpoints. added to the allow-list and to marking */
+			std::vector<std::string> getAllowedAddresses(const std::set<std::string>& blocked_endpoints);
+
+		private:
+			/* will not do anything on error */
+			void tryLoadFromStorage();
+			void tryWriteToStorage();
+
+			/* merge sibling prefixes of the same region into their parent */
+			void _aggregate(util::net::Prefix prefix);
+
+			std::filesystem::path _storage_path;
+
+			/* catalog, by endpoint title */
+			util::net::Classifier _catalog;
+
+			std::mutex _prefixes_mutex;
+			std::map<util::net::Prefix, LearnedPrefix> _prefixes;
+
+			/* addresses observed this run, so rescanning the same socket isn't another hit */
+			std::set<std::string> _seen;
+
+			/* changed since the last write */
+			bool _dirty { false };
+	};
+}
@@ -0,0 +1,336 @@
+#include "RegionInference.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace core::latency {
+
+	namespace {
+		int64_t now()
+		{
+			return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+
+		float median(std::vector<float> values)
+		{
+			std::sort(values.begin(), values.end());
+
+			const size_t n = values.size();
+			return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.0f;
+		}
+	}
+
+	void to_json(json& j, const Inference& i)
+	{
+		j = json {
+			{ "cidr", i.cidr },
+			{ "region", i.region },
+			{ "p50", i.p50 },
+			{ "region_p50", i.region_p50 },
+			{ "measured", i.measured },
+		};
+	}
+
+	void from_json(const json& j, Inference& i)
+	{
+		j.at("cidr").get_to(i.cidr);
+		if (j.contains("region")) j.at("region").get_to(i.region);
+		if (j.contains("p50")) j.at("p50").get_to(i.p50);
+		if (j.contains("region_p50")) j.at("region_p50").get_to(i.region_p50);
+		if (j.contains("measured")) j.at("measured").get_to(i.measured);
+	}
+
+
+	RegionInference::RegionInference(util::ping::PingService& ping_service, RegionLatency& region_latency, std::filesystem::path storage_path) :
+		_ping_service(ping_service),
+		_region_latency(region_latency),
+		_storage_path(storage_path)
+	{
+		this->tryLoadFromStorage();
+	}
+
+	RegionInference::~RegionInference()
+	{
+		{
+			std::lock_guard lock(this->_mutex);
+
+			for (auto& [prefix, probing] : this->_probing)
+			{
+				for (auto& [address, target] : probing.targets)
+				{
+					this->_ping_service.remove(target);
+				}
+			}
+		}
+
+		this->tryWriteToStorage();
+	}
+
+	void RegionInference::infer(const std::string& address)
+	{
+		auto a = util::net::Address::parse(address);
+		if (!a) return;
+
+		const auto prefix = util::net::Prefix::of(a.value(), a.value().v4() ? __v4_length : __v6_length);
+
+		std::lock_guard lock(this->_mutex);
+
+		if (this->_inferences.contains(prefix)) return;
+
+		/* another address of a range on trial joins it */
+		if (auto it = this->_probing.find(prefix); it != this->_probing.end())
+		{
+			auto& targets = it->second.targets;
+			const bool known = std::any_of(targets.begin(), targets.end(), [&](const auto& t) { return t.first == address; });
+			if (known || targets.size() + it->second.p50s.size() >= __addresses) return;
+
+			try {
+				targets.emplace_back(address, this->_ping_service.add(address, { .method = util::ping::Method::unreachable, .while_paused = true }));
+			}
+			catch (const std::exception& e) {
+				std::cerr << "region inference: can't ping " << address << ": " << e.what() << std::endl;
+			}
+			return;
+		}
+
+		auto& queued = this->_queued[prefix];
+		if (queued.size() < __addresses) queued.insert(address);
+	}
+
+	void RegionInference::update()
+	{
+		bool changed = false;
+
+		{
+			std::lock_guard lock(this->_mutex);
+
+			for (auto it = this->_probing.begin(); it != this->_probing.end();)
+			{
+				auto& [prefix, probing] = *it;
+
+				for (auto target = probing.targets.begin(); target != probing.targets.end();)
+				{
+					const auto statistics = this->_ping_service.getStatistics(target->second);
+
+					const bool gone = !statistics;
+					const bool silent = statistics && statistics->samples >= __silent_probes && !statistics->valid();
+					const bool judged = statistics && statistics->valid() && statistics->samples >= __judged_probes;
+
+					if (judged) probing.p50s.push_back(statistics->p50);
+
+					if (gone || silent || judged)
+					{
+						if (!gone) this->_ping_service.remove(target->second);
+						target = probing.targets.erase(target);
+						continue;
+					}
+
+					++target;
+				}
+
+				if (!probing.targets.empty())
+				{
+					++it;
+					continue;
+				}
+
+				std::optional<Inference> inference;
+				if (probing.p50s.empty())
+				{
+					inference = Inference {};
+					inference->cidr = prefix.toString();
+					inference->measured = now();
+				}
+				else
+				{
+					inference = this->_match(prefix, median(probing.p50s));
+				}
+
+				/* nothing to compare with yet, wait for the regions */
+				if (!inference)
+				{
+					++it;
+					continue;
+				}
+
+				this->_inferences[prefix] = inference.value();
+				changed = true;
+
+				it = this->_probing.erase(it);
+			}
+
+			/* the next batch. all of them share the service's ticks */
+			for (auto it = this->_queued.begin(); it != this->_queued.end() && this->_probing.size() < __batch;)
+			{
+				Probing probing;
+				for (auto& address : it->second)
+				{
+					try {
+						probing.targets.emplace_back(address, this->_ping_service.add(address, { .method = util::ping::Method::unreachable, .while_paused = true }));
+					}
+					catch (const std::exception& e) {
+						std::cerr << "region inference: can't ping " << address << ": " << e.what() << std::endl;
+					}
+				}
+
+				/* out of slots, try again on the next update */
+				if (probing.targets.empty()) break;
+
+				this->_probing[it->first] = std::move(probing);
+				it = this->_queued.erase(it);
+			}
+		}
+
+		if (changed) this->tryWriteToStorage();
+	}
+
+	std::optional<Inference> RegionInference::getInference(const std::string& address)
+	{
+		auto a = util::net::Address::parse(address);
+		if (!a) return std::nullopt;
+
+		const auto prefix = util::net::Prefix::of(a.value(), a.value().v4() ? __v4_length : __v6_length);
+
+		std::lock_guard lock(this->_mutex);
+
+		auto it = this->_inferences.find(prefix);
+		if (it == this->_inferences.end()) return std::nullopt;
+
+		return it->second;
+	}
+
+	std::optional<Inference> RegionInference::propose(const std::string& cidr)
+	{
+		auto outer = util::net::Prefix::parse(cidr);
+		if (!outer) return std::nullopt;
+
+		std::lock_guard lock(this->_mutex);
+
+		std::vector<const Inference*> answered;
+		for (auto& [prefix, inference] : this->_inferences)
+		{
+			const bool inside = prefix.length >= outer->length && outer->contains(prefix.address);
+			if (inside && inference.p50 > 0.0f) answered.push_back(&inference);
+		}
+
+		if (answered.empty()) return std::nullopt;
+
+		Inference proposal;
+		proposal.cidr = outer->toString();
+		proposal.region = answered.front()->region;
+		proposal.region_p50 = answered.front()->region_p50;
+
+		std::vector<float> p50s;
+		for (auto* inference : answered)
+		{
+			if (inference->region != proposal.region) proposal.region.clear();
+
+			p50s.push_back(inference->p50);
+			proposal.measured = std::max(proposal.measured, inference->measured);
+		}
+		proposal.p50 = median(p50s);
+
+		return proposal;
+	}
+
+	size_t RegionInference::getPending()
+	{
+		std::lock_guard lock(this->_mutex);
+		return this->_queued.size() + this->_probing.size();
+	}
+
+	std::optional<Inference> RegionInference::_match(const util::net::Prefix& prefix, float p50)
+	{
+		Inference inference;
+		inference.cidr = prefix.toString();
+		inference.p50 = p50;
+		inference.measured = now();
+
+		bool any = false;
+		size_t matches = 0;
+		float closest = 0.0f;
+
+		for (auto& [title, e] : dropship::settings::ow2_endpoints)
+		{
+			const auto estimate = this->_region_latency.getEstimate(title);
+			if (!estimate || estimate->p50 <= 0.0f) continue;
+
+			any = true;
+
+			const float distance = std::abs(p50 - estimate->p50);
+			if (distance > std::max(__tolerance_ms, __tolerance * estimate->p50)) continue;
+
+			if (matches++ == 0 || distance < closest)
+			{
+				closest = distance;
+				inference.region = title;
+				inference.region_p50 = estimate->p50;
+			}
+		}
+
+		if (!any) return std::nullopt;
+
+		/* two regions the same distance away, ex. neighbours on one continent. the rtt can't tell them apart */
+		if (matches > 1)
+		{
+			inference.region.clear();
+			inference.region_p50 = 0.0f;
+		}
+
+		return inference;
+	}
+
+	void RegionInference::tryLoadFromStorage()
+	{
+		std::ifstream file(this->_storage_path);
+		if (!file) return;
+
+		try {
+			std::vector<Inference> loaded = json::parse(file);
+
+			const auto cutoff = now() - __cache_days * 24 * 60 * 60;
+
+			for (auto& inference : loaded)
+			{
+				auto prefix = util::net::Prefix::parse(inference.cidr);
+				if (prefix && inference.measured >= cutoff) this->_inferences[prefix.value()] = inference;
+			}
+		}
+		catch (json::exception& e) {
+			std::cerr << "region inference: " << e.what() << std::endl;
+		}
+	}
+
+	void RegionInference::tryWriteToStorage()
+	{
+		std::string data;
+		{
+			std::lock_guard lock(this->_mutex);
+
+			/* ranges that didn't answer are left out, they're tried again next run */
+			json j = json::array();
+			for (auto& [prefix, inference] : this->_inferences)
+			{
+				if (inference.p50 > 0.0f) j.push_back(inference);
+			}
+			data = j.dump(4);
+		}
+
+		/* write then rename so a crash never leaves half a file */
+		std::error_code ec;
+		std::filesystem::create_directories(this->_storage_path.parent_path(), ec);
+
+		auto tmp = this->_storage_path;
+		tmp += ".tmp";
+
+		{
+			std::ofstream file(tmp, std::ios::trunc);
+			if (!(file << data)) return;
+		}
+
+		std::filesystem::rename(tmp, this->_storage_path, ec);
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "json/json.hpp"
+
+#include "core/RegionLatency.h"
+#include "util/net/cidr.h"
+#include "util/ping/PingService.h"
+
+/* no pch, shared by the windows and linux builds */
+
+namespace core::latency {
+
+	using json = nlohmann::json;
+
+	/* where a range outside the catalog probably is, from how far away it is */
+	struct Inference {
+		/* a /24 or /48 */
+		std::string cidr;
+
+		/* endpoint title whose latency matches. empty if none does, or more than one */
+		std::string region;
+
+		/* median rtt to the range's addresses, 0 if none answered. and the matched region's at the time */
+		float p50 { 0.0f };
+		float region_p50 { 0.0f };
+
+		/* unix seconds */
+		int64_t measured { 0 };
+	};
+
+	void to_json(json& j, const Inference& i);
+	void from_json(const json& j, Inference& i);
+
+	/*
+		guesses the region of servers the game talks to that the catalog doesn't know,
+		so a learned prefix doesn't need the research in catalog.h's comments to be blocked with the right region.
+		the addresses the game used in a range are probed the way region latency probes its own, and the range's rtt
+		is compared with every region's. a match close to one region and no other is proposed, anything else isn't.
+		ranges are probed together, a few dozen at a time, and each is measured once and kept for a month.
+		one that didn't answer is tried again on the next run
+	*/
+	class RegionInference
+	{
+		/* consts */
+		private:
+			/* ranges are measured at these lengths */
+			static constexpr int __v4_length { 24 };
+			static constexpr int __v6_length { 48 };
+
+			/* addresses probed per range, the ones the game used */
+			static constexpr size_t __addresses { 4 };
+
+			/* ranges probed at once. the rest wait their turn */
+			static constexpr size_t __batch { 32 };
+
+			/* probes before an address that never answered is dropped, and before one that did is judged */
+			static constexpr uint32_t __silent_probes { 3 };
+			static constexpr uint32_t __judged_probes { 6 };
+
+			/* a region matches if its p50 is within this many ms, or this much of it if that's more */
+			static constexpr float __tolerance_ms { 5.0f };
+			static constexpr float __tolerance { 0.15f };
+
+			/* measured ranges are probed again after this */
+			static constexpr int64_t __cache_days { 30 };
+
+		public:
+			/* both must outlive this */
+			RegionInference(util::ping::PingService& ping_service, RegionLatency& region_latency, std::filesystem::path storage_path);
+			~RegionInference();
+
+			/* an address of the game's that the catalog doesn't know. its range is measured unless it was already */
+			void infer(const std::string& address);
+
+			/* judge the probes, start the next ranges. call every few seconds */
+			void update();
+
+			/* the range of a single address. nullopt until it's measured */
+			std::optional<Inference> getInference(const std::string& address);
+
+			/*
+				the region the measured ranges inside cidr agree on, ex. a learned /22 with two measured /24s.
+				nullopt if none is measured yet, an empty region if they don't agree
+			*/
+			std::optional<Inference> propose(const std::string& cidr);
+
+			/* ranges waiting or being probed */
+			size_t getPending();
+
+		private:
+			struct Probing {
+				std::vector<std::pair<std::string, util::ping::TargetId>> targets;
+
+				/* rtts of the addresses judged so far */
+				std::vector<float> p50s;
+			};
+
+			/* will not do anything on error */
+			void tryLoadFromStorage();
+			void tryWriteToStorage();
+
+			/* the closest region within the tolerance, if no other one is. nullopt until some region has a latency */
+			std::optional<Inference> _match(const util::net::Prefix& prefix, float p50);
+
+			util::ping::PingService& _ping_service;
+			RegionLatency& _region_latency;
+			std::filesystem::path _storage_path;
+
+			std::mutex _mutex;
+
+			std::map<util::net::Prefix, Inference> _inferences;
+			std::map<util::net::Prefix, Probing> _probing;
+
+			/* addresses seen in ranges that wait their turn */
+			std::map<util::net::Prefix, std::set<std::string>> _queued;
+	};
+}
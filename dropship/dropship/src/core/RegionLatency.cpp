@@ -0,0 +1,435 @@
+#include "RegionLatency.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace core::latency {
+
+	namespace {
+		int64_t now()
+		{
+			return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+
+		float median(std::vector<float> values)
+		{
+			std::sort(values.begin(), values.end());
+
+			const size_t n = values.size();
+			return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.0f;
+		}
+
+		/* "USA - Central" -> "usa_central" */
+		std::string fileName(const std::string& title)
+		{
+			std::string name;
+			for (char c : title)
+			{
+				if (std::isalnum(static_cast<unsigned char>(c)))
+					name += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+				else if (!name.empty() && name.back() != '_')
+					name += '_';
+			}
+
+			while (!name.empty() && name.back() == '_') name.pop_back();
+			return name;
+		}
+
+		/* the steadier half of the answering addresses, so one odd address can't move the number */
+		Estimate estimateOf(std::vector<std::pair<float, util::ping::Statistics>> answering, size_t candidates)
+		{
+			std::sort(answering.begin(), answering.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+			answering.resize((answering.size() + 1) / 2);
+
+			std::vector<float> last, p50, p95, jitter;
+			for (auto& [score, statistics] : answering)
+			{
+				if (statistics.last >= 0.0f) last.push_back(statistics.last);
+				p50.push_back(statistics.p50);
+				p95.push_back(statistics.p95);
+				jitter.push_back(statistics.jitter);
+			}
+
+			Estimate estimate;
+			estimate.last = last.empty() ? -1.0f : median(last);
+			estimate.p50 = median(p50);
+			estimate.p95 = median(p95);
+			estimate.jitter = median(jitter);
+
+			std::vector<float> deviations;
+			for (auto value : p50)
+			{
+				deviations.push_back(std::abs(value - estimate.p50));
+			}
+			estimate.spread = median(deviations);
+
+			estimate.responders = static_cast<uint32_t>(answering.size());
+			estimate.candidates = static_cast<uint32_t>(candidates);
+
+			return estimate;
+		}
+
+		/* host byte order */
+		uint32_t toV4(const util::net::Address& a)
+		{
+			return (uint32_t(a.bytes[12]) << 24) | (uint32_t(a.bytes[13]) << 16) | (uint32_t(a.bytes[14]) << 8) | a.bytes[15];
+		}
+	}
+
+	void to_json(json& j, const Responder& r)
+	{
+		j = json {
+			{ "address", r.address },
+			{ "region", r.region },
+			{ "p50", r.p50 },
+			{ "jitter", r.jitter },
+			{ "loss", r.loss },
+			{ "last_seen", r.last_seen },
+		};
+	}
+
+	void from_json(const json& j, Responder& r)
+	{
+		j.at("address").get_to(r.address);
+		j.at("region").get_to(r.region);
+		if (j.contains("p50")) j.at("p50").get_to(r.p50);
+		if (j.contains("jitter")) j.at("jitter").get_to(r.jitter);
+		if (j.contains("loss")) j.at("loss").get_to(r.loss);
+		if (j.contains("last_seen")) j.at("last_seen").get_to(r.last_seen);
+	}
+
+
+	RegionLatency::RegionLatency(util::ping::PingService& ping_service, std::filesystem::path storage_path, std::filesystem::path history_path) :
+		_ping_service(ping_service),
+		_storage_path(storage_path),
+		_random(std::random_device {}())
+	{
+		this->tryLoadFromStorage();
+
+		std::error_code ec;
+		std::filesystem::create_directories(history_path, ec);
+
+		std::lock_guard lock(this->_regions_mutex);
+
+		for (auto& [title, e] : dropship::settings::ow2_endpoints)
+		{
+			auto& region = this->_regions[title];
+
+			try {
+				region.history = std::make_unique<History>(history_path / (fileName(title) + ".ring"));
+			}
+			catch (const std::exception& ex) {
+				std::cerr << "region latency: no history for " << title << ": " << ex.what() << std::endl;
+			}
+
+			/* something to show until the first replies */
+			const auto last = region.history ? region.history->getLast() : std::nullopt;
+			if (last)
+			{
+				region.estimate = Estimate {
+					.last = last->last,
+					.p50 = last->p50,
+					.p95 = last->p95,
+					.jitter = last->jitter,
+					.spread = last->spread,
+					.responders = last->responders,
+					.candidates = last->candidates,
+					.previous = true,
+				};
+			}
+
+			for (auto& s : e.blocked_servers)
+			{
+				if (!dropship::settings::ow2_servers.contains(s)) continue;
+
+				for (auto& prefix : util::net::parsePrefixes(dropship::settings::ow2_servers.at(s).block))
+				{
+					/* a random address in an ipv6 /44 is never in use */
+					if (prefix.address.v4()) region.prefixes.push_back(prefix);
+				}
+			}
+
+			/* tcp if its icmp is filtered, sampled addresses are just replaced */
+			if (!e.ip_ping.empty()) this->_probe(region, e.ip_ping, true, { .method = util::ping::Method::automatic, .port = e.ping_port });
+			if (!e.ip_ping_v6.empty()) this->_probe(region, e.ip_ping_v6, true, { .method = util::ping::Method::automatic, .port = e.ping_port });
+
+			/* last run's responders, steadiest first */
+			std::vector<const Responder*> cached;
+			for (auto& [address, responder] : this->_responders)
+			{
+				if (responder.region == title) cached.push_back(&responder);
+			}
+
+			std::sort(cached.begin(), cached.end(), [](const Responder* a, const Responder* b)
+			{
+				return a->jitter + a->loss * __loss_penalty_ms < b->jitter + b->loss * __loss_penalty_ms;
+			});
+
+			/* as many of each family */
+			size_t v4 = 0, v6 = 0;
+			for (auto* responder : cached)
+			{
+				auto& count = responder->address.find(':') != std::string::npos ? v6 : v4;
+				if (count < __responders && this->_probe(region, responder->address, false)) count++;
+			}
+		}
+	}
+
+	RegionLatency::~RegionLatency()
+	{
+		{
+			std::lock_guard lock(this->_regions_mutex);
+
+			for (auto& [title, region] : this->_regions)
+			{
+				for (auto& candidate : region.candidates)
+				{
+					this->_ping_service.remove(candidate.target);
+				}
+			}
+		}
+
+		this->tryWriteToStorage();
+	}
+
+	void RegionLatency::update()
+	{
+		bool responders_changed = false;
+
+		{
+			std::lock_guard lock(this->_regions_mutex);
+
+			for (auto& [title, region] : this->_regions)
+			{
+				/* lower is steadier */
+				std::vector<std::pair<float, util::ping::Statistics>> answering;
+				std::vector<std::pair<float, util::ping::Statistics>> answering_v6;
+				size_t judged = 0;
+				size_t candidates_v6 = 0;
+
+				for (auto it = region.candidates.begin(); it != region.candidates.end();)
+				{
+					const auto statistics = this->_ping_service.getStatistics(it->target);
+					if (!statistics)
+					{
+						it = region.candidates.erase(it);
+						continue;
+					}
+
+					const bool silent = statistics->samples >= __silent_probes && !statistics->valid();
+					const bool lossy = statistics->samples >= __judged_probes && statistics->loss() > __max_loss;
+
+					if (!it->pinned && (silent || lossy))
+					{
+						this->_ping_service.remove(it->target);
+						responders_changed |= this->_responders.erase(it->address) > 0;
+
+						it = region.candidates.erase(it);
+						continue;
+					}
+
+					if (statistics->valid())
+					{
+						(it->v6 ? answering_v6 : answering).emplace_back(statistics->jitter + (statistics->p95 - statistics->p50) + statistics->loss() * __loss_penalty_ms, statistics.value());
+					}
+
+					candidates_v6 += it->v6;
+
+					if (statistics->valid() && statistics->samples >= __judged_probes)
+					{
+						/* the search only samples ipv4 */
+						judged += !it->v6;
+
+						responders_changed |= !this->_responders.contains(it->address);
+						this->_responders[it->address] = {
+							.address = it->address,
+							.region = title,
+							.p50 = statistics->p50,
+							.jitter = statistics->jitter,
+							.loss = statistics->loss(),
+							.last_seen = now(),
+						};
+					}
+
+					++it;
+				}
+
+				/* keep searching until enough addresses proved steady */
+				while (judged < __responders && region.candidates.size() - candidates_v6 - judged < __trials)
+				{
+					const auto address = this->_sample(region);
+					if (!address || !this->_probe(region, address.value(), false)) break;
+				}
+
+				/* no history for ipv6, it's measured only where the game has been */
+				region.estimate_v6.reset();
+				if (!answering_v6.empty()) region.estimate_v6 = estimateOf(std::move(answering_v6), candidates_v6);
+
+				if (answering.empty())
+				{
+					if (!region.estimate || !region.estimate->previous) region.estimate.reset();
+					continue;
+				}
+
+				const auto estimate = estimateOf(std::move(answering), region.candidates.size() - candidates_v6);
+				region.estimate = estimate;
+
+				/* paused, the estimate is frozen. a copy of it with a new time would pass for a measurement */
+				const auto replies = this->_ping_service.getCounters().replies;
+				const bool fresh = !this->_ping_service.isPaused() && replies != region.recorded_replies;
+
+				if (region.history && fresh && now() - region.last_recorded >= __history_interval)
+				{
+					region.last_recorded = now();
+					region.recorded_replies = replies;
+					region.history->append({
+						.time = region.last_recorded,
+						.last = estimate.last,
+						.p50 = estimate.p50,
+						.p95 = estimate.p95,
+						.jitter = estimate.jitter,
+						.spread = estimate.spread,
+						.responders = static_cast<uint16_t>(std::min<uint32_t>(estimate.responders, UINT16_MAX)),
+						.candidates = static_cast<uint16_t>(std::min<uint32_t>(estimate.candidates, UINT16_MAX)),
+					});
+				}
+			}
+		}
+
+		if (responders_changed) this->tryWriteToStorage();
+	}
+
+	void RegionLatency::addServer(const std::string& address, const std::string& region)
+	{
+		auto a = util::net::Address::parse(address);
+		if (!a || a->v4()) return;
+
+		std::lock_guard lock(this->_regions_mutex);
+
+		auto it = this->_regions.find(region);
+		if (it == this->_regions.end() || it->second.tried.contains(a->toString())) return;
+
+		auto& candidates = it->second.candidates;
+		const auto v6 = std::count_if(candidates.begin(), candidates.end(), [](const Candidate& c) { return c.v6; });
+
+		/* a server that doesn't answer is dropped like a sampled address, and makes room for the next one the game uses */
+		if (static_cast<size_t>(v6) < __responders) this->_probe(it->second, a->toString(), false);
+	}
+
+	std::optional<Estimate> RegionLatency::getEstimate(const std::string& region, bool v6)
+	{
+		std::lock_guard lock(this->_regions_mutex);
+
+		auto it = this->_regions.find(region);
+		if (it == this->_regions.end()) return std::nullopt;
+
+		return v6 ? it->second.estimate_v6 : it->second.estimate;
+	}
+
+	std::vector<Record> RegionLatency::getHistory(const std::string& region, int64_t since)
+	{
+		History* history = nullptr;
+		{
+			std::lock_guard lock(this->_regions_mutex);
+
+			auto it = this->_regions.find(region);
+			if (it == this->_regions.end()) return {};
+
+			history = it->second.history.get();
+		}
+
+		/* regions live as long as we do, and the history is read without a lock */
+		return history ? history->query(since) : std::vector<Record> {};
+	}
+
+	bool RegionLatency::_probe(Region& region, const std::string& address, bool pinned, util::ping::Probe probe)
+	{
+		region.tried.insert(address);
+
+		try {
+			const bool v6 = address.find(':') != std::string::npos;
+			region.candidates.push_back({ .address = address, .target = this->_ping_service.add(address, probe), .pinned = pinned, .v6 = v6 });
+			return true;
+		}
+		catch (const std::exception& e) {
+			std::cerr << "region latency: can't ping " << address << ": " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	std::optional<std::string> RegionLatency::_sample(Region& region)
+	{
+		if (region.prefixes.empty() || region.tried.size() >= __max_tried) return std::nullopt;
+
+		/* every prefix equally likely, or the big ones would crowd out the small ones */
+		std::uniform_int_distribution<size_t> pick_prefix(0, region.prefixes.size() - 1);
+
+		for (int attempt = 0; attempt < 8; attempt++)
+		{
+			const auto& prefix = region.prefixes[pick_prefix(this->_random)];
+
+			/* skip the network and broadcast addresses when there are any */
+			const int host_bits = 32 - prefix.familyLength();
+			const uint64_t hosts = uint64_t(1) << host_bits;
+			const uint64_t host = hosts > 2 ? std::uniform_int_distribution<uint64_t>(1, hosts - 2)(this->_random) : 0;
+
+			const auto address = util::net::Address::fromV4(toV4(prefix.address) + static_cast<uint32_t>(host)).toString();
+			if (!region.tried.contains(address)) return address;
+		}
+
+		return std::nullopt;
+	}
+
+	void RegionLatency::tryLoadFromStorage()
+	{
+		std::ifstream file(this->_storage_path);
+		if (!file) return;
+
+		try {
+			std::vector<Responder> loaded = json::parse(file);
+
+			const auto cutoff = now() - __cache_days * 24 * 60 * 60;
+
+			for (auto& responder : loaded)
+			{
+				if (responder.last_seen >= cutoff) this->_responders[responder.address] = responder;
+			}
+		}
+		catch (json::exception& e) {
+			std::cerr << "region latency: " << e.what() << std::endl;
+		}
+	}
+
+	void RegionLatency::tryWriteToStorage()
+	{
+		std::string data;
+		{
+			std::lock_guard lock(this->_regions_mutex);
+
+			json j = json::array();
+			for (auto& [address, responder] : this->_responders)
+			{
+				j.push_back(responder);
+			}
+			data = j.dump(4);
+		}
+
+		/* write then rename so a crash never leaves half a file */
+		std::error_code ec;
+		std::filesystem::create_directories(this->_storage_path.parent_path(), ec);
+
+		auto tmp = this->_storage_path;
+		tmp += ".tmp";
+
+		{
+			std::ofstream file(tmp, std::ios::trunc);
+			if (!(file << data)) return;
+		}
+
+		std::filesystem::rename(tmp, this->_storage_path, ec);
+	}
+}
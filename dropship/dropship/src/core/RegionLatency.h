@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "json/json.hpp"
+
+#include "core/Catalog.h"
+#include "core/LatencyHistory.h"
+#include "util/net/cidr.h"
+#include "util/ping/PingService.h"
+
+/* no pch, shared by the windows and linux builds */
+
+namespace core::latency {
+
+	using json = nlohmann::json;
+
+	/* an address that answered before, kept across runs so startup doesn't have to search again */
+	struct Responder {
+		std::string address;
+
+		/* endpoint title */
+		std::string region;
+
+		float p50 { 0.0f };
+		float jitter { 0.0f };
+		float loss { 0.0f };
+
+		int64_t last_seen { 0 };
+	};
+
+	void to_json(json& j, const Responder& r);
+	void from_json(const json& j, Responder& r);
+
+	/* latency of a region, from several of its addresses */
+	struct Estimate {
+		/* medians across the steadiest responders. last is -1 if none of them answered the last probe */
+		float last { -1.0f };
+		float p50 { 0.0f };
+		float p95 { 0.0f };
+		float jitter { 0.0f };
+
+		/* median distance of their p50s from the region's. large if the addresses disagree, ex. anycast */
+		float spread { 0.0f };
+
+		/* addresses that count towards the estimate, and how many are being probed */
+		uint32_t responders { 0 };
+		uint32_t candidates { 0 };
+
+		/* the last one of a previous run, from the history. until this run has its own */
+		bool previous { false };
+	};
+
+	/*
+		pings several live addresses per region instead of one hand picked ip_ping
+		addresses are sampled at random from the region's ipv4 prefixes in the catalog,
+		kept if they answer steadily and replaced if they don't.
+		a random address in an ipv6 /44 is never in use, so ipv6 is measured on the servers the game was seen using
+		and on ip_ping_v6, as an estimate of its own.
+		they're probed with a datagram to a closed port, so the number follows the path and firewalls of game traffic.
+		ip_ping is always one of them, so a region whose servers don't answer that still has a number
+		estimates are kept in a history per region, which also gives the first frame a number
+	*/
+	class RegionLatency
+	{
+		/* consts */
+		private:
+			/* steady responders wanted per region. the search stops once there are this many */
+			static constexpr size_t __responders { 4 };
+
+			/* addresses on trial per region while searching */
+			static constexpr size_t __trials { 8 };
+
+			/* probes before an address that never answered is dropped */
+			static constexpr uint32_t __silent_probes { 2 };
+
+			/* probes before a responder is judged on its loss */
+			static constexpr uint32_t __judged_probes { 4 };
+			static constexpr float __max_loss { 0.5f };
+
+			/* a loss this big weighs like this many ms of jitter when ranking responders */
+			static constexpr float __loss_penalty_ms { 100.0f };
+
+			/* stop trying addresses in a region after this many, start over on the next run */
+			static constexpr size_t __max_tried { 512 };
+
+			/* cached responders older than this are not tried */
+			static constexpr int64_t __cache_days { 30 };
+
+			/* seconds between history records */
+			static constexpr int64_t __history_interval { 30 };
+
+		public:
+			/* the ping service must outlive this. history_path is a directory, with a file per region */
+			RegionLatency(util::ping::PingService& ping_service, std::filesystem::path storage_path, std::filesystem::path history_path);
+			~RegionLatency();
+
+			/* judge the addresses on trial, pick new ones and recompute the estimates. call every few seconds */
+			void update();
+
+			/* a server of the region the game used, ex. from its sockets. ipv6 ones are probed for the region's ipv6 estimate */
+			void addServer(const std::string& address, const std::string& region);
+
+			/* endpoint title. nullopt until an address of the family in the region answered */
+			std::optional<Estimate> getEstimate(const std::string& region, bool v6 = false);
+
+			/* estimates of a region from since (unix seconds) on, oldest first. doesn't wait for update */
+			std::vector<Record> getHistory(const std::string& region, int64_t since);
+
+		private:
+			struct Candidate {
+				std::string address;
+				util::ping::TargetId target;
+
+				/* ip_ping from the catalog, never dropped */
+				bool pinned { false };
+
+				/* kept apart from the sampled ipv4 ones, they have an estimate of their own */
+				bool v6 { false };
+			};
+
+			struct Region {
+				std::vector<util::net::Prefix> prefixes;
+				std::vector<Candidate> candidates;
+				std::set<std::string> tried;
+				std::optional<Estimate> estimate;
+				std::optional<Estimate> estimate_v6;
+
+				/* null if the file couldn't be opened */
+				std::unique_ptr<History> history;
+				int64_t last_recorded { 0 };
+
+				/* the service's replies at the last record. none since, nothing new to record */
+				uint64_t recorded_replies { 0 };
+			};
+
+			/* will not do anything on error */
+			void tryLoadFromStorage();
+			void tryWriteToStorage();
+
+			/* start pinging an address. false if the service refused it */
+			bool _probe(Region& region, const std::string& address, bool pinned, util::ping::Probe probe = { .method = util::ping::Method::unreachable });
+
+			/* a random host address in one of the region's prefixes, not tried before */
+			std::optional<std::string> _sample(Region& region);
+
+			util::ping::PingService& _ping_service;
+			std::filesystem::path _storage_path;
+
+			std::mt19937 _random;
+
+			std::mutex _regions_mutex;
+			std::map<std::string, Region> _regions;
+
+			/* by address */
+			std::map<std::string, Responder> _responders;
+	};
+}
@@ -0,0 +1,145 @@
+#include "Replay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+#include "util/pcap/pcap.h"
+
+namespace core::replay {
+
+	namespace {
+		struct FlowKey
+		{
+			util::net::Address remote;
+			uint16_t port;
+			uint8_t protocol;
+
+			bool operator==(const FlowKey&) const = default;
+		};
+
+		struct FlowKeyHash
+		{
+			size_t operator()(const FlowKey& k) const
+			{
+				/* fnv-1a */
+				uint64_t h = 14695981039346656037ull;
+				auto mix = [&h](uint8_t b) { h = (h ^ b) * 1099511628211ull; };
+
+				for (auto b : k.remote.bytes) mix(b);
+				mix(static_cast<uint8_t>(k.port >> 8));
+				mix(static_cast<uint8_t>(k.port));
+				mix(k.protocol);
+
+				return static_cast<size_t>(h);
+			}
+		};
+	}
+
+	util::net::Classifier serverClassifier()
+	{
+		util::net::Classifier result;
+
+		for (auto& [key, server] : dropship::settings::ow2_servers)
+		{
+			result.add(key, server.block);
+		}
+
+		return result;
+	}
+
+	Report run(const std::filesystem::path& capture, const std::set<std::string>& blocked_endpoints)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		const auto classifier = serverClassifier();
+		const auto& servers = classifier.getLabels();
+
+		/* per server, looked up by label index in the loop */
+		std::vector<std::vector<std::string>> server_endpoints(servers.size());
+		std::vector<bool> server_dropped(servers.size(), false);
+
+		for (size_t i = 0; i < servers.size(); i++)
+		{
+			for (auto& [title, e] : dropship::settings::ow2_endpoints)
+			{
+				if (std::find(e.blocked_servers.begin(), e.blocked_servers.end(), servers[i]) == e.blocked_servers.end()) continue;
+
+				server_endpoints[i].push_back(title);
+				if (blocked_endpoints.contains(title)) server_dropped[i] = true;
+			}
+		}
+
+		Report report;
+		std::unordered_map<FlowKey, Flow, FlowKeyHash> flows;
+
+		util::pcap::Reader reader(capture);
+		util::pcap::Packet packet;
+
+		while (reader.next(packet))
+		{
+			report.packets++;
+
+			auto datagram = util::pcap::decode(packet);
+			if (!datagram)
+			{
+				report.undecoded_packets++;
+				continue;
+			}
+
+			/* whichever side is a game server is the remote */
+			FlowKey key { datagram->destination, datagram->destination_port, datagram->protocol };
+			int server = classifier.classifyIndex(datagram->destination);
+
+			if (server < 0)
+			{
+				server = classifier.classifyIndex(datagram->source);
+				key = { datagram->source, datagram->source_port, datagram->protocol };
+			}
+
+			if (server < 0)
+			{
+				report.uncatalogued_packets++;
+				continue;
+			}
+
+			auto [it, inserted] = flows.try_emplace(key);
+			auto& flow = it->second;
+
+			if (inserted)
+			{
+				flow.remote_port = key.port;
+				flow.protocol = key.protocol;
+				flow.server = servers[server];
+				flow.endpoints = server_endpoints[server];
+				flow.dropped = server_dropped[server];
+				flow.first_seen_ns = packet.timestamp_ns;
+			}
+
+			flow.packets++;
+			flow.bytes += datagram->length;
+			flow.last_seen_ns = packet.timestamp_ns;
+
+			if (flow.dropped)
+			{
+				report.dropped_packets++;
+				report.dropped_bytes += datagram->length;
+			}
+		}
+
+		report.flows.reserve(flows.size());
+		for (auto& [key, flow] : flows)
+		{
+			/* formatted once per flow, not per packet */
+			flow.remote_address = key.remote.toString();
+			report.flows.push_back(std::move(flow));
+		}
+
+		std::sort(report.flows.begin(), report.flows.end(), [](const Flow& a, const Flow& b) { return a.packets > b.packets; });
+
+		report.file_size = reader.getSize();
+		report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		return report;
+	}
+}
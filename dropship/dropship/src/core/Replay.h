@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "core/Catalog.h"
+#include "util/net/cidr.h"
+
+/* no pch, shared by the windows and linux builds */
+
+namespace core::replay {
+
+	/* traffic to or from one catalogued server address */
+	struct Flow
+	{
+		std::string remote_address;
+		uint16_t remote_port { 0 };
+
+		/* IPPROTO_* */
+		uint8_t protocol { 0 };
+
+		/* key in ow2_servers, and the endpoints that use it */
+		std::string server;
+		std::vector<std::string> endpoints;
+
+		/* this block set would have dropped it */
+		bool dropped { false };
+
+		uint64_t packets { 0 };
+		uint64_t bytes { 0 };
+
+		int64_t first_seen_ns { 0 };
+		int64_t last_seen_ns { 0 };
+	};
+
+	struct Report
+	{
+		uint64_t packets { 0 };
+
+		/* not ip, or a link type we can't decode */
+		uint64_t undecoded_packets { 0 };
+
+		/* neither side is in the catalog */
+		uint64_t uncatalogued_packets { 0 };
+
+		uint64_t dropped_packets { 0 };
+		uint64_t dropped_bytes { 0 };
+
+		/* most packets first */
+		std::vector<Flow> flows;
+
+		uint64_t file_size { 0 };
+		double seconds { 0.0 };
+	};
+
+	/*
+		replay a pcap/pcapng capture against a set of blocked endpoint titles
+		a server is dropped if any blocked endpoint uses it, same as Settings::getAllBlockedAddresses
+		throws std::runtime_error if the capture can't be read
+	*/
+	Report run(const std::filesystem::path& capture, const std::set<std::string>& blocked_endpoints);
+
+	/* what run() classifies with, labelled by ow2_servers key */
+	util::net::Classifier serverClassifier();
+}
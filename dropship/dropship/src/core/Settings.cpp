@@ -313,6 +313,7 @@ Settings::Settings() {
 			key,
 			e.description,
 			this->_dropship_app_settings.options.ping_servers ? e.ip_ping : "",
+			e.ping_port,
 			blocked
 		));
 	}
@@ -31,6 +31,7 @@
 #include "core/Update.h"
 #include "core/Tunneling.h"
 
+#include "util/ping/PingService.h"
 #include "util/watcher/window.h"
 
 // Dear ImGui: standalone example application for DirectX 11
@@ -89,6 +90,7 @@ HWND g_hwnd = nullptr;
     std::unique_ptr<Settings> g_settings;
     std::unique_ptr<core::tunneling::Tunneling> g_tunneling;
     std::unique_ptr<util::watcher::window::WindowWatcher> g_window_watcher;
+    std::unique_ptr<util::ping::PingService> g_ping_service;
 //}
 
 
@@ -377,6 +379,7 @@ int main(int, char**)
 #ifdef _DEBUG
         g_debug = std::make_unique<Debug>();
 #endif
+        g_ping_service = std::make_unique<util::ping::PingService>();
         g_endpoints = std::make_unique<std::vector<std::shared_ptr<Endpoint2>>>();
         g_firewall = std::make_unique<Firewall>();
         //g_process_watcher = std::make_unique<ProcessWatcher>("Overwatch.exe");
@@ -493,6 +496,15 @@ int main(int, char**)
         g_pSwapChain->Present(1, 0); // Present with vsync
         //g_pSwapChain->Present(0, 0); // Present without vsync
 
+        /* probes would only compete with the game, and nobody reads them while minimized */
+        if (g_ping_service)
+        {
+            const auto dashboard = ImGui::FindWindowByName("dashboard");
+            const bool minimized = dashboard && dashboard->Viewport && (dashboard->Viewport->Flags & ImGuiViewportFlags_IsMinimized);
+
+            g_ping_service->setPaused(minimized || (g_window_watcher && g_window_watcher->isActive()));
+        }
+
         {
             if (ImGui::IsKeyPressed(ImGuiKey_Escape))
             {
@@ -521,6 +533,7 @@ int main(int, char**)
     g_settings.reset();
     g_dashboard.reset();
     g_updater.reset();
+    g_ping_service.reset(); // after g_endpoints, they unregister on destruction
 
     /*delete font_title;
     delete font_subtitle;
@@ -3,8 +3,12 @@
 
 #include "pch_linux.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <clocale>
+#include <ctime>
 #include <memory>
 #include <optional>
 #include <future>
@@ -12,7 +16,12 @@
 #include <unordered_map>
 #include <string>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <netinet/in.h>
 
 // ImGui backends
 #include "imgui-docking/imgui_impl_glfw.h"
@@ -21,12 +30,28 @@
 // OpenGL/GLFW
 #include <GLFW/glfw3.h>
 
+// Core
+#include "core/GameLatency.h"
+#include "core/LearnedPrefixes.h"
+#include "core/RegionInference.h"
+#include "core/RegionLatency.h"
+#include "core/Replay.h"
+
 // Platform
 #include "platform/platform.h"
+#include "platform/capture/capture.h"
+#include "platform/conntrack/conntrack.h"
+#include "platform/connections/connections.h"
 #include "platform/firewall/firewall.h"
 #include "platform/http/http.h"
+#include "platform/network/network.h"
 #include "platform/privileges.h"
 
+// Util
+#include "util/ping/PingService.h"
+#include "util/ping/Traceroute.h"
+#include "util/pcap/pcap.h"
+
 // Fonts
 ImFont* font_title = nullptr;
 ImFont* font_subtitle = nullptr;
@@ -35,6 +60,84 @@ ImFont* font_text = nullptr;
 bool dashboard_open = true;
 bool show_privilege_dialog = false;
 
+// Latest state from the network monitor, written from its thread
+std::mutex network_information_mutex;
+platform::network::NetworkInformation network_information;
+
+// Game server ranges seen in game but missing from the catalog
+std::unique_ptr<core::learned::LearnedPrefixes> learned_prefixes;
+double last_connections_scan = 0.0;
+double last_game_search = -1e9;
+std::optional<int> game_pid;
+std::atomic<bool> game_running = false;
+
+// Set by the conntrack monitor when a udp flow that may be the game's starts or ends, and the scan follows at once
+// Conntrack only tracks once something uses it, so the connections are polled until the first event shows it does
+std::atomic<bool> flows_changed = false;
+std::atomic<bool> flow_events_live = false;
+
+// The server the game is on, from its sockets. Empty title if the catalog doesn't know the address
+struct GameServer {
+    std::string title;
+    std::string address;
+    uint16_t port = 0;
+};
+std::optional<GameServer> game_server;
+std::string game_tcp_region;
+
+// The game's cgroup, once found. Marking and the allow-list are scoped to it, and stay on it after the game closes
+std::optional<std::string> game_cgroup;
+
+// What the firewall should hold, picked in the ui and kept across runs in firewall.json
+// Blocks stay in the firewall when dropship closes, like the Windows rule does. Marking and the allow-list are taken out
+std::set<std::string> blocked_endpoints;
+bool priority_marking = false;
+bool allow_list = false;
+platform::firewall::DscpClass priority_class = platform::firewall::DscpClass::EF;
+
+// Applying takes an iptables call per prefix, so it runs off the ui thread. A change while it runs applies after it
+std::future<bool> firewall_commit;
+bool firewall_dirty = true;
+std::string firewall_status;
+
+// In game latency to that server, from the timing of the game's own packets. Needs CAP_NET_RAW
+std::unique_ptr<platform::capture::Ring> game_ring;
+std::unique_ptr<core::latency::GameLatency> game_latency;
+std::future<void> game_capture;
+std::string game_capture_flow;
+
+// The last minutes of traffic to game servers, kept on disk while the game runs so a bad match can be saved
+// The writer outlives the game, the match is over by the time someone wants it
+std::unique_ptr<platform::capture::Ring> recorder_ring;
+std::unique_ptr<util::pcap::SegmentWriter> recorder;
+std::future<void> recorder_capture;
+std::vector<std::string> recorder_prefixes;
+std::future<std::string> recorder_save;
+std::string recorder_status;
+
+// Latency to several addresses in each region, by endpoint title. Over ipv6 to the servers the game used there
+std::unique_ptr<util::ping::PingService> ping_service;
+std::unique_ptr<core::latency::RegionLatency> region_latency;
+
+// Which region the game's servers outside the catalog are likely in, from their latency against each region's
+std::unique_ptr<core::latency::RegionInference> region_inference;
+
+// Path to each region's ip_ping, traced while its node is open. Null if it can't be traced
+std::map<std::string, std::unique_ptr<util::ping::Traceroute>> path_traces;
+double last_latency_update = 0.0;
+
+constexpr const char* GAME_PROCESS = "Overwatch.exe";
+constexpr const char* BLOCK_RULE = "BLOCK";
+constexpr double CONNECTIONS_SCAN_INTERVAL = 1.0;
+constexpr double GAME_SEARCH_INTERVAL = 5.0;
+constexpr double LATENCY_UPDATE_INTERVAL = 2.0;
+
+// Game traffic is a few hundred packets a second of a few hundred bytes, 8 x 4 MB holds around 15 minutes of it
+constexpr uint32_t RECORDER_SEGMENTS = 8;
+constexpr uint32_t RECORDER_SEGMENT_SIZE = 4 << 20;
+constexpr uint32_t RECORDER_SNAP_LENGTH = 2048;
+constexpr uint32_t LINKTYPE_RAW = 101;
+
 // GLFW error callback
 static void glfw_error_callback(int error, const char* description) {
     fprintf(stderr, "GLFW Error %d: %s\n", error, description);
@@ -76,6 +179,332 @@ std::filesystem::path getResourcePath() {
     return std::filesystem::current_path();
 }
 
+// Writable data directory (XDG_DATA_HOME or ~/.local/share/dropship)
+std::filesystem::path getDataPath() {
+    if (const char* xdg_data = std::getenv("XDG_DATA_HOME")) {
+        return std::filesystem::path(xdg_data) / "dropship";
+    }
+    if (const char* home = std::getenv("HOME")) {
+        return std::filesystem::path(home) / ".local" / "share" / "dropship";
+    }
+    return std::filesystem::current_path();
+}
+
+// Find the server the game is on, and record its udp remotes that the catalog doesn't know about
+// The region is taken from any of its other connections the catalog does know
+// Looking through every process and every tcp socket is the slow part, so they're only done every few seconds,
+// or when a flow to a game server starts before the game is found
+void scanGameConnections(bool flow_started) {
+    const bool search = ImGui::GetTime() - last_game_search >= GAME_SEARCH_INTERVAL || (flow_started && !game_pid);
+    if (!game_pid && !search) {
+        return;
+    }
+    if (search) {
+        last_game_search = ImGui::GetTime();
+    }
+    
+    game_pid = platform::connections::findProcess(GAME_PROCESS, game_pid);
+    game_running = game_pid.has_value();
+    game_server.reset();
+    if (!game_pid) {
+        game_tcp_region.clear();
+        return;
+    }
+    
+    if (auto cgroup = search ? platform::connections::getProcessCgroup(game_pid.value()) : std::nullopt;
+        cgroup && cgroup != game_cgroup) {
+        game_cgroup = cgroup;
+        firewall_dirty = true;
+    }
+
+    // In a match the udp flow is the server. Tcp is the launcher and chat, it only tells the region when udp can't
+    auto connections = platform::connections::getProcessConnections(game_pid.value(), false);
+
+    std::string region;
+    for (const auto& connection : connections) {
+        if (auto known = learned_prefixes->classify(connection.remote_address)) {
+            region = known.value();
+            game_server = GameServer { region, connection.remote_address, connection.remote_port };
+            break;
+        }
+    }
+    
+    if (region.empty() && search) {
+        game_tcp_region.clear();
+        for (const auto& connection : platform::connections::getProcessConnections(game_pid.value())) {
+            auto known = connection.protocol == IPPROTO_TCP ? learned_prefixes->classify(connection.remote_address) : std::nullopt;
+            if (known) {
+                game_tcp_region = known.value();
+                break;
+            }
+        }
+    }
+    if (region.empty()) {
+        region = game_tcp_region;
+    }
+    
+    // In a match on a server nobody knows yet
+    if (!game_server && !connections.empty()) {
+        game_server = GameServer { "", connections.front().remote_address, connections.front().remote_port };
+    }
+
+    // A region's ipv6 servers can't be sampled, the ones the game uses are measured instead
+    for (const auto& connection : connections) {
+        if (auto known = learned_prefixes->classify(connection.remote_address)) {
+            region_latency->addServer(connection.remote_address, known.value());
+        }
+    }
+    
+    // Somewhere the game didn't say where it is, find out from how far away it is
+    for (const auto& connection : connections) {
+        if (connection.protocol == IPPROTO_UDP && learned_prefixes->observe(connection.remote_address, region) && region.empty()) {
+            region_inference->infer(connection.remote_address);
+        }
+    }
+}
+
+void loadFirewallSettings() {
+    std::ifstream file(getDataPath() / "firewall.json");
+    if (!file) {
+        return;
+    }
+    
+    try {
+        auto j = nlohmann::json::parse(file);
+        for (const auto& title : j.value("blocked_endpoints", std::vector<std::string>())) {
+            if (dropship::settings::ow2_endpoints.contains(title)) {
+                blocked_endpoints.insert(title);
+            }
+        }
+        priority_marking = j.value("priority_marking", false);
+        allow_list = j.value("allow_list", false);
+        priority_class = j.value("priority_class", std::string("EF")) == "CS4" ? platform::firewall::DscpClass::CS4
+                                                                             : platform::firewall::DscpClass::EF;
+    } catch (const nlohmann::json::exception& e) {
+        std::cerr << "Can't read the firewall settings: " << e.what() << "\n";
+    }
+}
+
+void saveFirewallSettings() {
+    nlohmann::json j = {
+        { "blocked_endpoints", blocked_endpoints },
+        { "priority_marking", priority_marking },
+        { "allow_list", allow_list },
+        { "priority_class", priority_class == platform::firewall::DscpClass::CS4 ? "CS4" : "EF" },
+    };
+    
+    // Write then rename so a crash never leaves half a file
+    std::error_code ec;
+    std::filesystem::create_directories(getDataPath(), ec);
+    
+    const auto path = getDataPath() / "firewall.json";
+    auto tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::trunc);
+        if (!(file << j.dump(4))) {
+            return;
+        }
+    }
+    std::filesystem::rename(tmp, path, ec);
+}
+
+// Catalog ranges of the blocked regions
+std::vector<std::string> getCatalogBlocks(const std::set<std::string>& blocked) {
+    std::set<std::string> servers;
+    for (const auto& title : blocked) {
+        const auto& endpoint = dropship::settings::ow2_endpoints.at(title);
+        servers.insert(endpoint.blocked_servers.begin(), endpoint.blocked_servers.end());
+    }
+    
+    std::vector<std::string> addresses;
+    for (const auto& server : servers) {
+        if (dropship::settings::ow2_servers.contains(server)) {
+            auto cidrs = dropship::settings::split_block(dropship::settings::ow2_servers.at(server).block);
+            addresses.insert(addresses.end(), cidrs.begin(), cidrs.end());
+        }
+    }
+    return addresses;
+}
+
+// Put the blocks and the marking in the firewall, if they changed and the last commit is done
+void commitFirewall() {
+    if (firewall_commit.valid()) {
+        if (firewall_commit.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+        // Without the game's cgroup the allow-list would drop the udp of every process, so it waits for it
+        if (!firewall_commit.get()) {
+            firewall_status = "Some rules could not be applied, see the log";
+        } else {
+            firewall_status = allow_list && !game_cgroup ? "The allow-list starts with the game" : "";
+        }
+    }
+    if (!firewall_dirty) {
+        return;
+    }
+    firewall_dirty = false;
+    
+    if (!platform::privileges::isRoot()) {
+        firewall_status = "Not applied, needs root";
+        return;
+    }
+    
+    // The catalog's ranges, and the learned ones merged into their region
+    auto blocks = getCatalogBlocks(blocked_endpoints);
+    auto allowed = dropship::settings::allowed_addresses(blocked_endpoints);
+    for (auto& cidr : learned_prefixes->getBlockedAddresses(blocked_endpoints)) {
+        blocks.push_back(std::move(cidr));
+    }
+    for (auto& cidr : learned_prefixes->getAllowedAddresses(blocked_endpoints)) {
+        allowed.push_back(std::move(cidr));
+    }
+    
+    firewall_commit = std::async(std::launch::async, [blocks = std::move(blocks), allowed = std::move(allowed), priority = priority_marking,
+                                                      allow = allow_list, dscp = priority_class, cgroup = game_cgroup]() {
+        // The chain and its jump, then what it drops
+        platform::firewall::FirewallRule rule;
+        rule.name = BLOCK_RULE;
+        rule.group = BLOCK_RULE;
+        bool applied = platform::firewall::createRule(rule)
+            && platform::firewall::setRuleAddresses(BLOCK_RULE, blocks);
+        
+        // Everything the game may still connect to goes ahead of bulk traffic
+        if (priority) {
+            applied = platform::firewall::setPriorityMarking(allowed, dscp, cgroup) && applied;
+        } else {
+            platform::firewall::clearPriorityMarking();
+        }
+        
+        // Servers nobody put in the catalog yet are dropped with the blocked ones
+        if (allow && cgroup) {
+            applied = platform::firewall::setAllowList(allowed, cgroup.value()) && applied;
+        } else if (!allow) {
+            platform::firewall::clearAllowList();
+        }
+        return applied;
+    });
+}
+
+void stopGameCapture() {
+    if (game_ring) {
+        game_ring->stop();
+        game_capture.wait();
+    }
+    game_ring.reset();
+    game_latency.reset();
+}
+
+// Follow the server the game is on with a capture of its flow
+// The rtt by active probes lines the passive one up, the capture starts in the middle of the flow
+void updateGameCapture() {
+    const auto flow = game_server ? game_server->address + ":" + std::to_string(game_server->port) : std::string();
+    if (flow == game_capture_flow) {
+        return;
+    }
+    game_capture_flow = flow;
+    stopGameCapture();
+    
+    if (!game_server) {
+        return;
+    }
+    
+    std::optional<float> expected;
+    if (auto estimate = region_latency->getEstimate(game_server->title); estimate && estimate->p50 > 0.0f) {
+        expected = estimate->p50;
+    }
+    
+    try {
+        // Only the timing is used, so the ring keeps no more than the headers
+        auto filter = platform::capture::flowFilter(game_server->address, game_server->port, IPPROTO_UDP, 64);
+        game_ring = std::make_unique<platform::capture::Ring>(filter);
+    } catch (const std::exception& e) {
+        std::cerr << "Can't capture the game's traffic: " << e.what() << "\n";
+        return;
+    }
+    game_latency = std::make_unique<core::latency::GameLatency>(expected);
+    
+    game_capture = std::async(std::launch::async, [ring = game_ring.get(), latency = game_latency.get()]() {
+        while (ring->poll(1000, [latency](const platform::capture::Frame& frame) {
+            latency->observe(frame.timestamp_ns, frame.outgoing);
+        })) {
+        }
+    });
+}
+
+void stopRecorder() {
+    if (recorder_ring) {
+        recorder_ring->stop();
+        recorder_capture.wait();
+    }
+    recorder_ring.reset();
+    recorder_prefixes.clear();
+}
+
+// Record everything to and from the catalog's blocks, the learned prefixes and the server the game is on
+// A filter can't tell which process a packet is for, so the game is picked out by the addresses its sockets talk to
+void updateRecorder() {
+    if (!game_running) {
+        stopRecorder();
+        return;
+    }
+    
+    std::vector<std::string> prefixes;
+    for (const auto& [name, server] : dropship::settings::ow2_servers) {
+        prefixes.push_back(server.block);
+    }
+    for (const auto& prefix : learned_prefixes->getPrefixes()) {
+        prefixes.push_back(prefix.cidr);
+    }
+    if (game_server) {
+        prefixes.push_back(game_server->address);
+    }
+    if (prefixes == recorder_prefixes) {
+        return;
+    }
+    
+    try {
+        auto filter = platform::capture::prefixFilter(prefixes, RECORDER_SNAP_LENGTH);
+        
+        // The ring's packets stay when the filter changes
+        if (recorder_ring) {
+            if (!recorder_ring->setFilter(filter)) {
+                throw std::runtime_error("can't swap the filter");
+            }
+            recorder_prefixes = prefixes;
+            return;
+        }
+        
+        if (!recorder) {
+            recorder = std::make_unique<util::pcap::SegmentWriter>(getDataPath() / "recorder", RECORDER_SEGMENTS,
+                                                                   RECORDER_SEGMENT_SIZE, LINKTYPE_RAW, RECORDER_SNAP_LENGTH);
+        }
+        
+        // Bigger blocks that retire slowly, the writer only needs them once a second
+        recorder_ring = std::make_unique<platform::capture::Ring>(filter, platform::capture::RingOptions {
+            .block_size = 1 << 20, .block_count = 8, .retire_ms = 1000 });
+    } catch (const std::exception& e) {
+        std::cerr << "Can't record the game's traffic: " << e.what() << "\n";
+        stopRecorder();
+        
+        // Not again until something changes
+        recorder_prefixes = prefixes;
+        return;
+    }
+    recorder_prefixes = prefixes;
+    
+    // One write per poll, whatever the blocks held
+    recorder_capture = std::async(std::launch::async, [ring = recorder_ring.get(), writer = recorder.get()]() {
+        while (ring->poll(1000, [writer](const platform::capture::Frame& frame) {
+            writer->add(frame.timestamp_ns, frame.data, frame.length, frame.original_length,
+                        frame.outgoing ? util::pcap::Direction::outbound : util::pcap::Direction::inbound);
+        })) {
+            writer->flush();
+        }
+        writer->flush();
+    });
+}
+
 // Temporary: render a placeholder UI until the real UI is ported
 void renderPlaceholderUI(bool* p_open) {
     ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | 
@@ -114,6 +543,298 @@ void renderPlaceholderUI(bool* p_open) {
             ImGui::TextColored(ImVec4(0.8f, 0.2f, 0.2f, 1.0f), "iptables: Not available");
         }
         
+        // Network status
+        {
+            std::lock_guard lock(network_information_mutex);
+            if (network_information.default_interface.empty()) {
+                ImGui::TextColored(ImVec4(0.8f, 0.2f, 0.2f, 1.0f), "Network: Offline");
+            } else {
+                ImGui::Text("Network: %s (%d connected)", network_information.default_interface.c_str(),
+                            network_information.connected_networks_count);
+            }
+            if (network_information.vpn_detected) {
+                ImGui::BulletText("VPN detected. If servers are not blocked,\nturning it off may fix this problem");
+            }
+        }
+        
+        // Game
+        if (game_server && dropship::settings::ow2_endpoints.contains(game_server->title)) {
+            ImGui::Text("Connected to: %s (%s)", game_server->title.c_str(),
+                        dropship::settings::ow2_endpoints.at(game_server->title).description.c_str());
+            ImGui::SameLine();
+            ImGui::TextDisabled("%s:%u", game_server->address.c_str(), game_server->port);
+        } else if (auto inferred = game_server ? region_inference->getInference(game_server->address) : std::nullopt;
+                   inferred && !inferred->region.empty()) {
+            ImGui::Text("Connected to: unknown server, likely %s", inferred->region.c_str());
+            ImGui::SameLine();
+            ImGui::TextDisabled("%s:%u", game_server->address.c_str(), game_server->port);
+        } else if (game_server) {
+            ImGui::Text("Connected to: unknown server");
+            ImGui::SameLine();
+            ImGui::TextDisabled("%s:%u", game_server->address.c_str(), game_server->port);
+        } else if (game_running) {
+            ImGui::TextDisabled("Game running, not connected to a server");
+        }
+        
+        // Firewall
+        ImGui::Spacing();
+        ImGui::Separator();
+        ImGui::Spacing();
+        
+        ImGui::Text("Blocked regions");
+        bool firewall_changed = false;
+        for (const auto& [title, endpoint] : dropship::settings::ow2_endpoints) {
+            bool blocked = blocked_endpoints.contains(title);
+            if (ImGui::Checkbox(title.c_str(), &blocked)) {
+                if (blocked) {
+                    blocked_endpoints.insert(title);
+                } else {
+                    blocked_endpoints.erase(title);
+                }
+                firewall_changed = true;
+            }
+            ImGui::SameLine();
+            ImGui::TextDisabled("%s", endpoint.description.c_str());
+        }
+        
+        // DSCP for the router, socket priority for the wifi queues of this box
+        firewall_changed |= ImGui::Checkbox("Prioritize game traffic", &priority_marking);
+        if (priority_marking) {
+            ImGui::SameLine();
+            if (ImGui::RadioButton("EF", priority_class == platform::firewall::DscpClass::EF)) {
+                priority_class = platform::firewall::DscpClass::EF;
+                firewall_changed = true;
+            }
+            ImGui::SameLine();
+            if (ImGui::RadioButton("CS4", priority_class == platform::firewall::DscpClass::CS4)) {
+                priority_class = platform::firewall::DscpClass::CS4;
+                firewall_changed = true;
+            }
+        }
+        
+        firewall_changed |= ImGui::Checkbox("Block servers outside the catalog too", &allow_list);
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Drops the game's udp to anything but the regions above that aren't blocked,\n"
+                              "so new server ranges are blocked until they're in the catalog.\n"
+                              "Voice chat and other udp services outside the catalog are dropped too");
+        }
+        
+        if (firewall_changed) {
+            saveFirewallSettings();
+            firewall_dirty = true;
+        }
+        if (!firewall_status.empty()) {
+            ImGui::TextDisabled("%s", firewall_status.c_str());
+        }
+        
+        // Latency
+        ImGui::Spacing();
+        ImGui::Separator();
+        ImGui::Spacing();
+        
+        ImGui::Text("Latency");
+        if (!ping_service->isAvailable(false)) {
+            ImGui::TextDisabled("Timing with udp and tcp, icmp needs root or your group in net.ipv4.ping_group_range");
+        }
+        if (ping_service->isPaused()) {
+            ImGui::TextDisabled("Paused while the game is running");
+        }
+        auto formatPing = [](std::optional<int> ping) {
+            if (!ping) {
+                return std::string("...");
+            }
+            return ping.value() < 0 ? std::string("timed out") : std::to_string(ping.value()) + " ms";
+        };
+        for (const auto& [title, endpoint] : dropship::settings::ow2_endpoints) {
+            auto estimate = region_latency->getEstimate(title);
+            auto text = formatPing(estimate ? std::optional<int>(static_cast<int>(std::lround(estimate->last))) : std::nullopt);
+            if (auto v6 = region_latency->getEstimate(title, true)) {
+                text += ", v6 " + formatPing(static_cast<int>(std::lround(v6->last)));
+            }
+            
+            // Next to the probes, what the game itself sees. Gone once the flow goes quiet
+            if (game_latency && game_server && game_server->title == title) {
+                auto passive = game_latency->getEstimate();
+                const auto age = std::chrono::system_clock::now().time_since_epoch() - std::chrono::nanoseconds(passive.updated_ns);
+                if (passive.paired && passive.statistics.valid() && age < std::chrono::seconds(3)) {
+                    char buffer[64];
+                    snprintf(buffer, sizeof(buffer), ", in game %.0f ms, loss %.1f%%", passive.statistics.p50, passive.statistics.loss() * 100.0f);
+                    text += buffer;
+                }
+            }
+            ImGui::BulletText("%s: %s", title.c_str(), text.c_str());
+            
+            // A day of the region's p50, against the week's
+            if (ImGui::IsItemHovered()) {
+                const int64_t now = std::time(nullptr);
+                auto week = region_latency->getHistory(title, now - 7 * 24 * 60 * 60);
+                if (!week.empty() && ImGui::BeginTooltip()) {
+                    std::vector<float> day;
+                    std::vector<float> p50s;
+                    for (const auto& record : week) {
+                        p50s.push_back(record.p50);
+                        if (record.time >= now - 24 * 60 * 60) {
+                            day.push_back(record.p50);
+                        }
+                    }
+                    std::nth_element(p50s.begin(), p50s.begin() + p50s.size() / 2, p50s.end());
+                    ImGui::Text("Median p50 this week: %.0f ms", p50s[p50s.size() / 2]);
+                    if (!day.empty()) {
+                        ImGui::PlotLines("##day", day.data(), static_cast<int>(day.size()), 0, "p50, last 24 hours", 0.0f, FLT_MAX, ImVec2(320, 80));
+                    }
+                    ImGui::EndTooltip();
+                }
+            }
+            
+            if (estimate) {
+                ImGui::SameLine();
+                ImGui::TextDisabled("(p50 %.0f, p95 %.0f, jitter %.1f, spread %.1f ms, %u of %u addresses)",
+                    estimate->p50, estimate->p95, estimate->jitter, estimate->spread, estimate->responders, estimate->candidates);
+                if (estimate->previous) {
+                    ImGui::SameLine();
+                    ImGui::TextDisabled("from the last session");
+                }
+            }
+            
+            if (endpoint.ip_ping.empty()) {
+                continue;
+            }
+            
+            ImGui::PushID(title.c_str());
+            ImGui::Indent();
+            if (ImGui::TreeNode("Path")) {
+                if (!path_traces.contains(title)) {
+                    // Routers answer a udp probe as well as an icmp one, and it needs no privileges
+                    auto method = ping_service->isAvailable(false) ? util::ping::Method::icmp : util::ping::Method::unreachable;
+                    try {
+                        path_traces[title] = std::make_unique<util::ping::Traceroute>(*ping_service, endpoint.ip_ping, method);
+                    } catch (const std::exception& e) {
+                        std::cerr << "Can't trace " << endpoint.ip_ping << ": " << e.what() << "\n";
+                        path_traces[title] = nullptr;
+                    }
+                }
+                
+                if (auto& trace = path_traces.at(title)) {
+                    auto hops = trace->getHops();
+                    
+                    // Nothing past the furthest hop that answered yet
+                    while (!hops.empty() && !hops.back().address) {
+                        hops.pop_back();
+                    }
+                    
+                    for (const auto& hop : hops) {
+                        if (hop.statistics.valid()) {
+                            ImGui::Text("%2u  %-15s  %6.1f ms  loss %.0f%%", hop.ttl, hop.address.value_or("*").c_str(),
+                                        hop.statistics.p50, hop.statistics.loss() * 100.0f);
+                        } else {
+                            ImGui::TextDisabled("%2u  *", hop.ttl);
+                        }
+                    }
+                    if (!trace->isComplete()) {
+                        ImGui::TextDisabled("Tracing...");
+                    }
+                } else {
+                    ImGui::TextDisabled("Can't trace %s", endpoint.ip_ping.c_str());
+                }
+                ImGui::TreePop();
+            } else {
+                path_traces.erase(title);
+            }
+            ImGui::Unindent();
+            ImGui::PopID();
+        }
+        
+        // Learned prefixes
+        ImGui::Spacing();
+        ImGui::Separator();
+        ImGui::Spacing();
+        
+        ImGui::Text("Learned prefixes");
+        auto prefixes = learned_prefixes->getPrefixes();
+        if (prefixes.empty()) {
+            ImGui::TextDisabled("None yet, play a match to discover servers outside the catalog");
+        }
+        for (const auto& prefix : prefixes) {
+            ImGui::PushID(prefix.cidr.c_str());
+            ImGui::Text("%s  %s  (%u hits)", prefix.cidr.c_str(),
+                        prefix.region.empty() ? "unknown region" : prefix.region.c_str(), prefix.hits);
+            ImGui::SameLine();
+            
+            // A guess from the latency, until it's accepted. Measured during the match, the game's server can't wait for it to close
+            if (prefix.region.empty()) {
+                auto proposal = region_inference->propose(prefix.cidr);
+                if (proposal && !proposal->region.empty()) {
+                    ImGui::TextDisabled("likely %s, %.0f ms against its %.0f ms", proposal->region.c_str(), proposal->p50, proposal->region_p50);
+                    ImGui::SameLine();
+                    if (ImGui::Button("Accept")) {
+                        learned_prefixes->setRegion(prefix.cidr, proposal->region);
+                    }
+                    ImGui::SameLine();
+                } else if (proposal) {
+                    ImGui::TextDisabled("%.0f ms, no single region matches", proposal->p50);
+                    ImGui::SameLine();
+                }
+            }
+            
+            // Only prefixes with a region can be blocked with it. Merged, it's blocked and allowed with the region's ranges
+            ImGui::BeginDisabled(prefix.region.empty());
+            if (ImGui::Button(prefix.merged ? "Unmerge" : "Merge")) {
+                learned_prefixes->setMerged(prefix.cidr, !prefix.merged);
+                firewall_dirty = true;
+            }
+            ImGui::EndDisabled();
+            ImGui::SameLine();
+            
+            if (ImGui::Button("Forget")) {
+                learned_prefixes->forget(prefix.cidr);
+                firewall_dirty = prefix.merged || firewall_dirty;
+            }
+            ImGui::PopID();
+        }
+        
+        // Recorder
+        ImGui::Spacing();
+        ImGui::Separator();
+        ImGui::Spacing();
+        
+        ImGui::Text("Recorder");
+        if (!recorder) {
+            ImGui::TextDisabled("Starts with the game, keeps its last minutes of traffic. Needs root");
+        } else {
+            const uint64_t packets = recorder->getPackets();
+            ImGui::Text("%llu packets, the last %.1f minutes%s", static_cast<unsigned long long>(packets),
+                        recorder->getSpanNs() / 60e9, recorder_ring ? "" : " (stopped)");
+            
+            if (recorder_save.valid() && recorder_save.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                recorder_status = recorder_save.get();
+            }
+            
+            // Copying the segments takes a moment, and the capture waits on the writer meanwhile
+            ImGui::BeginDisabled(packets == 0 || recorder_save.valid());
+            if (ImGui::Button("Save")) {
+                char name[64];
+                const std::time_t now = std::time(nullptr);
+                std::strftime(name, sizeof(name), "match-%Y%m%d-%H%M%S.pcapng", std::localtime(&now));
+                const auto path = getDataPath() / "recordings" / name;
+                
+                recorder_save = std::async(std::launch::async, [writer = recorder.get(), path]() {
+                    try {
+                        std::filesystem::create_directories(path.parent_path());
+                        writer->save(path);
+                        return "Saved to " + path.string();
+                    } catch (const std::exception& e) {
+                        return std::string("Can't save: ") + e.what();
+                    }
+                });
+                recorder_status = "Saving...";
+            }
+            ImGui::EndDisabled();
+            if (!recorder_status.empty()) {
+                ImGui::SameLine();
+                ImGui::TextDisabled("%s", recorder_status.c_str());
+            }
+        }
+        
         ImGui::Spacing();
         ImGui::Separator();
         ImGui::Spacing();
@@ -173,12 +894,74 @@ void renderPlaceholderUI(bool* p_open) {
     }
 }
 
-int main(int argc, char** argv) {
-    (void)argc;
-    (void)argv;
+// dropship --replay <capture> [--block "Region,Region"]
+// Prints which flows of a capture the given block set would have dropped
+int runReplay(int argc, char** argv) {
+    std::string capture;
+    std::set<std::string> blocked;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--replay" && i + 1 < argc) {
+            capture = argv[++i];
+        } else if (arg == "--block" && i + 1 < argc) {
+            for (auto& title : dropship::settings::split_block(argv[++i])) {
+                if (!dropship::settings::ow2_endpoints.contains(title)) {
+                    std::cerr << "Unknown region: " << title << "\n";
+                    return 1;
+                }
+                blocked.insert(title);
+            }
+        }
+    }
+    
+    if (capture.empty()) {
+        std::cerr << "Usage: dropship --replay <capture.pcap|pcapng> [--block \"Region,Region\"]\n";
+        return 1;
+    }
+    
+    core::replay::Report report;
+    try {
+        report = core::replay::run(capture, blocked);
+    } catch (const std::exception& e) {
+        std::cerr << "Replay failed: " << e.what() << "\n";
+        return 1;
+    }
+    
+    const double megabytes = report.file_size / 1e6;
+    printf("%llu packets, %.1f MB in %.3fs (%.0f MB/s)\n", (unsigned long long)report.packets, megabytes,
+           report.seconds, report.seconds > 0 ? megabytes / report.seconds : 0.0);
+    printf("%llu dropped (%llu bytes), %llu not in the catalog, %llu not ip\n\n",
+           (unsigned long long)report.dropped_packets, (unsigned long long)report.dropped_bytes,
+           (unsigned long long)report.uncatalogued_packets, (unsigned long long)report.undecoded_packets);
+    
+    for (const auto& flow : report.flows) {
+        std::string endpoints;
+        for (const auto& e : flow.endpoints) {
+            endpoints += endpoints.empty() ? e : ", " + e;
+        }
+        
+        printf("%s  %s %s:%u  %s (%s)  %llu packets, %llu bytes, %.1fs\n",
+               flow.dropped ? "DROP" : "pass",
+               flow.protocol == IPPROTO_UDP ? "udp" : flow.protocol == IPPROTO_TCP ? "tcp" : "ip ",
+               flow.remote_address.c_str(), flow.remote_port, flow.server.c_str(), endpoints.c_str(),
+               (unsigned long long)flow.packets, (unsigned long long)flow.bytes,
+               (flow.last_seen_ns - flow.first_seen_ns) / 1e9);
+    }
     
+    return 0;
+}
+
+int main(int argc, char** argv) {
     setlocale(LC_ALL, "en_US.UTF-8");
     
+    // Command line modes, no window or root needed
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--replay") {
+            return runReplay(argc, argv);
+        }
+    }
+    
     // Check privileges
     if (!platform::privileges::isRoot()) {
         std::cerr << "Warning: Dropship requires root privileges for firewall management.\n";
@@ -258,10 +1041,71 @@ int main(int argc, char** argv) {
     if (!platform::firewall::initialize()) {
         std::cerr << "Warning: Failed to initialize firewall subsystem\n";
     }
+    loadFirewallSettings();
+    
+    // One ping service for every region
+    ping_service = std::make_unique<util::ping::PingService>();
+    region_latency = std::make_unique<core::latency::RegionLatency>(*ping_service, getDataPath() / "region_latency.json", getDataPath() / "history");
+    learned_prefixes = std::make_unique<core::learned::LearnedPrefixes>(getDataPath() / "learned_prefixes.json");
+    region_inference = std::make_unique<core::latency::RegionInference>(*ping_service, *region_latency, getDataPath() / "region_inference.json");
+    
+    // Watch for new networks, vpns and default route changes
+    // A network manager may reload the firewall on these, so put our rules back
+    if (!platform::network::startMonitor([](const platform::network::NetworkInformation& info) {
+            {
+                std::lock_guard lock(network_information_mutex);
+                network_information = info;
+            }
+            platform::firewall::validateRules();
+            
+            // Latency over the old network says nothing about the new one
+            ping_service->reprobe();
+        })) {
+        std::cerr << "Warning: Failed to start network monitor\n";
+    }
+    
+    // Wake the main loop as soon as the game may have connected somewhere, or left
+    // While it runs any udp flow may be it, before it's found only one to a game server can be it starting up
+    if (!platform::conntrack::startMonitor([](const platform::conntrack::Event& event) {
+            flow_events_live = true;
+            if (game_running || learned_prefixes->classify(event.destination_address)) {
+                flows_changed = true;
+                glfwPostEmptyEvent();
+            }
+        })) {
+        std::cerr << "Warning: Failed to start conntrack monitor, polling the game's connections\n";
+    }
     
     // Main loop
     while (!glfwWindowShouldClose(window) && dashboard_open) {
-        glfwPollEvents();
+        // Nobody sees the window, so don't draw it every frame
+        const bool hidden = glfwGetWindowAttrib(window, GLFW_ICONIFIED) || !glfwGetWindowAttrib(window, GLFW_VISIBLE);
+        if (hidden) {
+            glfwWaitEventsTimeout(CONNECTIONS_SCAN_INTERVAL);
+        } else {
+            glfwPollEvents();
+        }
+        
+        // With conntrack events the connections only change when they say so
+        const bool changed = flows_changed.exchange(false);
+        const bool polled = !flow_events_live && ImGui::GetTime() - last_connections_scan > CONNECTIONS_SCAN_INTERVAL;
+        if (changed || polled || ImGui::GetTime() - last_game_search >= GAME_SEARCH_INTERVAL) {
+            last_connections_scan = ImGui::GetTime();
+            scanGameConnections(changed);
+            updateGameCapture();
+            updateRecorder();
+        }
+        
+        commitFirewall();
+        
+        // Probes would only compete with the game, and nobody reads them while hidden. Region inference's few keep going
+        ping_service->setPaused(hidden || game_running);
+        
+        if (ImGui::GetTime() - last_latency_update > LATENCY_UPDATE_INTERVAL) {
+            last_latency_update = ImGui::GetTime();
+            region_latency->update();
+            region_inference->update();
+        }
         
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
@@ -289,7 +1133,35 @@ int main(int argc, char** argv) {
         }
     }
     
+    // The monitors call into the ping service and glfw
+    platform::network::stopMonitor();
+    platform::conntrack::stopMonitor();
+    stopGameCapture();
+    stopRecorder();
+    if (recorder_save.valid()) {
+        recorder_save.wait();
+    }
+    recorder.reset();
+    
+    // Stop pinging
+    region_inference.reset();
+    region_latency.reset();
+    path_traces.clear();
+    ping_service.reset();
+    
+    // Saves the last seen times of what the game still talked to
+    learned_prefixes.reset();
+    
     // Cleanup platform
+    if (firewall_commit.valid()) {
+        firewall_commit.wait();
+    }
+    if (priority_marking && platform::privileges::isRoot()) {
+        platform::firewall::clearPriorityMarking();
+    }
+    if (allow_list && platform::privileges::isRoot()) {
+        platform::firewall::clearAllowList();
+    }
     platform::firewall::shutdown();
     
     // Cleanup ImGui
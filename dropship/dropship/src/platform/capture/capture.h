@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <linux/filter.h>
+
+namespace platform::capture {
+
+// A packet in the ring, starting at its ip header. Only valid inside the handler, it's not copied out
+struct Frame {
+    // Kernel time the packet was sent or received, unix ns
+    int64_t timestamp_ns = 0;
+
+    // Sent by this machine
+    bool outgoing = false;
+
+    int interface_index = 0;
+
+    const uint8_t* data = nullptr;
+
+    // Bytes in the ring, cut at the filter's snap length, and the packet's length on the wire
+    uint32_t length = 0;
+    uint32_t original_length = 0;
+};
+
+struct RingOptions {
+    // The kernel hands over whole blocks, when they fill or retire_ms after their first packet
+    uint32_t block_size = 1 << 16;
+    uint32_t block_count = 4;
+    uint32_t retire_ms = 100;
+};
+
+// Classic bpf, run on the ip header. Returns the bytes of a packet to keep, 0 to drop it
+using Filter = std::vector<sock_filter>;
+
+// Packets of one udp or tcp flow with a remote address and port, both ways, keeping snap_length bytes
+// Throws std::invalid_argument if the address doesn't parse
+Filter flowFilter(const std::string& address, uint16_t port, int protocol, uint32_t snap_length);
+
+// Packets from or to any address in the comma separated cidrs, keeping snap_length bytes
+// Throws std::invalid_argument if there are too many prefixes for one filter, a few hundred fit
+Filter prefixFilter(const std::vector<std::string>& cidrs, uint32_t snap_length);
+
+// TPACKET_V3 receive ring on every interface, with a bpf filter attached before it's bound
+// Needs CAP_NET_RAW. Throws std::runtime_error if it can't be set up
+class Ring {
+public:
+    Ring(const Filter& filter, const RingOptions& options = {});
+    ~Ring();
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    // Wait up to timeout_ms for filled blocks, and run handler on every packet in them, in place
+    // Returns false once stopped
+    bool poll(int timeout_ms, const std::function<void(const Frame&)>& handler);
+
+    // Wake a poll on another thread and make it return false, from now on
+    void stop();
+
+    // Swap the filter, from any thread. Packets already in the ring stay
+    bool setFilter(const Filter& filter);
+
+    // Packets the kernel dropped because the ring was full, since the last call
+    uint32_t takeDrops();
+
+private:
+    // Safe to call more than once
+    void _close();
+
+    int _fd = -1;
+    int _stop_fd = -1;
+
+    uint8_t* _map = nullptr;
+    size_t _map_size = 0;
+
+    RingOptions _options;
+
+    // Next block to read
+    uint32_t _block = 0;
+
+    std::atomic<bool> _stopped = false;
+};
+
+} // namespace platform::capture
@@ -0,0 +1,396 @@
+// Linux packet capture with a TPACKET_V3 ring
+// The kernel writes packets into blocks of a mapping shared with us, so reading them is no copy and no syscall
+
+#include "capture.h"
+#include "../platform.h"
+
+#if DROPSHIP_LINUX
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+#include "util/net/cidr.h"
+
+namespace platform::capture {
+
+namespace {
+    // Jump targets of a filter, resolved once it's written. Classic bpf only jumps forward
+    enum Label : int {
+        NEXT = -1,
+        ACCEPT,
+        DROP,
+        DESTINATION,
+        V6,
+
+        // From here on, made with Assembler::newLabel
+        DYNAMIC,
+    };
+
+    class Assembler {
+    public:
+        void op(uint16_t code, uint32_t k) {
+            this->code.push_back(BPF_STMT(code, k));
+        }
+
+        // Conditional jumps reach 255 instructions
+        void jump(uint16_t code, uint32_t k, int yes, int no) {
+            this->fixups.push_back({ this->code.size(), yes, no, false });
+            this->code.push_back(BPF_JUMP(code, k, 0, 0));
+        }
+
+        // Unconditional ones reach anywhere
+        void always(int to) {
+            this->fixups.push_back({ this->code.size(), to, NEXT, true });
+            this->code.push_back(BPF_JUMP(BPF_JMP | BPF_JA, 0, 0, 0));
+        }
+
+        void label(int label) {
+            this->labels[label] = this->code.size();
+        }
+
+        int newLabel() {
+            return this->next_label++;
+        }
+
+        Filter finish() {
+            for (const auto& fixup : this->fixups) {
+                if (fixup.always) {
+                    this->code[fixup.index].k = static_cast<uint32_t>(this->distance(fixup.index, fixup.yes));
+                    continue;
+                }
+                this->code[fixup.index].jt = this->offset(fixup.index, fixup.yes);
+                this->code[fixup.index].jf = this->offset(fixup.index, fixup.no);
+            }
+            if (this->code.size() > BPF_MAXINSNS) {
+                throw std::invalid_argument("filter too long");
+            }
+            return this->code;
+        }
+
+    private:
+        struct Fixup {
+            size_t index;
+            int yes;
+            int no;
+            bool always;
+        };
+
+        size_t distance(size_t from, int to) const {
+            return to == NEXT ? 0 : this->labels.at(to) - from - 1;
+        }
+
+        uint8_t offset(size_t from, int to) const {
+            const size_t distance = this->distance(from, to);
+            if (distance > 255) {
+                throw std::invalid_argument("filter jump too long");
+            }
+            return static_cast<uint8_t>(distance);
+        }
+
+        Filter code;
+        std::vector<Fixup> fixups;
+        std::map<int, size_t> labels;
+        int next_label = DYNAMIC;
+    };
+}
+
+Filter flowFilter(const std::string& address, uint16_t port, int protocol, uint32_t snap_length) {
+    in6_addr v6 {};
+    in_addr v4 {};
+    const bool is_v4 = inet_pton(AF_INET, address.c_str(), &v4) == 1;
+    if (!is_v4 && inet_pton(AF_INET6, address.c_str(), &v6) != 1) {
+        throw std::invalid_argument("not an address: " + address);
+    }
+
+    Assembler a;
+
+    // Version
+    a.op(BPF_LD | BPF_B | BPF_ABS, 0);
+    a.op(BPF_ALU | BPF_RSH | BPF_K, 4);
+    a.jump(BPF_JMP | BPF_JEQ | BPF_K, is_v4 ? 4 : 6, NEXT, DROP);
+
+    if (is_v4) {
+        a.op(BPF_LD | BPF_B | BPF_ABS, 9);
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(protocol), NEXT, DROP);
+
+        // Later fragments have no ports
+        a.op(BPF_LD | BPF_H | BPF_ABS, 6);
+        a.jump(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, DROP, NEXT);
+
+        // From the server, its port is the source
+        a.op(BPF_LD | BPF_W | BPF_ABS, 12);
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, ntohl(v4.s_addr), NEXT, DESTINATION);
+        a.op(BPF_LDX | BPF_B | BPF_MSH, 0);
+        a.op(BPF_LD | BPF_H | BPF_IND, 0);
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, port, ACCEPT, DROP);
+
+        // To the server
+        a.label(DESTINATION);
+        a.op(BPF_LD | BPF_W | BPF_ABS, 16);
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, ntohl(v4.s_addr), NEXT, DROP);
+        a.op(BPF_LDX | BPF_B | BPF_MSH, 0);
+        a.op(BPF_LD | BPF_H | BPF_IND, 2);
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, port, ACCEPT, DROP);
+    } else {
+        // Extension headers aren't followed, game traffic doesn't have them
+        a.op(BPF_LD | BPF_B | BPF_ABS, 6);
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(protocol), NEXT, DROP);
+
+        uint32_t words[4];
+        std::memcpy(words, &v6, sizeof(words));
+
+        for (uint32_t i = 0; i < 4; i++) {
+            a.op(BPF_LD | BPF_W | BPF_ABS, 8 + i * 4);
+            a.jump(BPF_JMP | BPF_JEQ | BPF_K, ntohl(words[i]), NEXT, DESTINATION);
+        }
+        a.op(BPF_LD | BPF_H | BPF_ABS, 40);
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, port, ACCEPT, DROP);
+
+        a.label(DESTINATION);
+        for (uint32_t i = 0; i < 4; i++) {
+            a.op(BPF_LD | BPF_W | BPF_ABS, 24 + i * 4);
+            a.jump(BPF_JMP | BPF_JEQ | BPF_K, ntohl(words[i]), NEXT, DROP);
+        }
+        a.op(BPF_LD | BPF_H | BPF_ABS, 42);
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, port, ACCEPT, DROP);
+    }
+
+    a.label(ACCEPT);
+    a.op(BPF_RET | BPF_K, snap_length);
+    a.label(DROP);
+    a.op(BPF_RET | BPF_K, 0);
+
+    return a.finish();
+}
+
+Filter prefixFilter(const std::vector<std::string>& cidrs, uint32_t snap_length) {
+    std::vector<util::net::Prefix> v4;
+    std::vector<util::net::Prefix> v6;
+    for (const auto& cidr : cidrs) {
+        for (const auto& prefix : util::net::parsePrefixes(cidr)) {
+            (prefix.address.v4() ? v4 : v6).push_back(prefix);
+        }
+    }
+
+    Assembler a;
+
+    // Version, the families are too far apart for a conditional jump
+    a.op(BPF_LD | BPF_B | BPF_ABS, 0);
+    a.op(BPF_ALU | BPF_RSH | BPF_K, 4);
+    a.jump(BPF_JMP | BPF_JEQ | BPF_K, 6, NEXT, DESTINATION);
+    a.always(V6);
+    a.label(DESTINATION);
+    const int ipv4 = a.newLabel();
+    a.jump(BPF_JMP | BPF_JEQ | BPF_K, 4, ipv4, NEXT);
+    a.always(DROP);
+    a.label(ipv4);
+
+    // Either address in any prefix. Every match returns on the spot, so no jump goes far
+    auto match = [&a, snap_length](const util::net::Prefix& prefix, uint32_t base, uint32_t first_word) {
+        const int length = prefix.familyLength();
+        const int next = a.newLabel();
+
+        for (uint32_t word = 0; static_cast<int>(word * 32) < length; word++) {
+            const int bits = std::min(32, length - static_cast<int>(word * 32));
+            const uint32_t mask = bits == 32 ? 0xffffffff : ~(0xffffffffu >> bits);
+
+            uint32_t value;
+            std::memcpy(&value, prefix.address.bytes.data() + (first_word + word) * 4, 4);
+
+            a.op(BPF_LD | BPF_W | BPF_ABS, base + word * 4);
+            a.op(BPF_ALU | BPF_AND | BPF_K, mask);
+            a.jump(BPF_JMP | BPF_JEQ | BPF_K, ntohl(value) & mask, NEXT, next);
+        }
+        a.op(BPF_RET | BPF_K, snap_length);
+        a.label(next);
+    };
+
+    for (const auto& prefix : v4) {
+        match(prefix, 12, 3);
+        match(prefix, 16, 3);
+    }
+    a.always(DROP);
+
+    a.label(V6);
+    for (const auto& prefix : v6) {
+        match(prefix, 8, 0);
+        match(prefix, 24, 0);
+    }
+
+    a.label(DROP);
+    a.op(BPF_RET | BPF_K, 0);
+
+    return a.finish();
+}
+
+Ring::Ring(const Filter& filter, const RingOptions& options) : _options(options) {
+    auto fail = [this](const char* what) {
+        const std::string message = std::string(what) + ": " + std::strerror(errno);
+        this->_close();
+        throw std::runtime_error(message);
+    };
+
+    // Protocol 0 receives nothing until the bind, after the filter is in place
+    this->_fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (this->_fd < 0) {
+        fail("packet socket");
+    }
+
+    int version = TPACKET_V3;
+    if (setsockopt(this->_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+        fail("PACKET_VERSION");
+    }
+
+    sock_fprog program {};
+    program.len = static_cast<unsigned short>(filter.size());
+    program.filter = const_cast<sock_filter*>(filter.data());
+    if (setsockopt(this->_fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) != 0) {
+        fail("SO_ATTACH_FILTER");
+    }
+
+    // Frames only matter to the kernel's size checks in v3, packets are packed into the blocks
+    tpacket_req3 request {};
+    request.tp_block_size = options.block_size;
+    request.tp_block_nr = options.block_count;
+    request.tp_frame_size = TPACKET_ALIGNMENT << 7;
+    request.tp_frame_nr = options.block_size / request.tp_frame_size * options.block_count;
+    request.tp_retire_blk_tov = options.retire_ms;
+    if (setsockopt(this->_fd, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) != 0) {
+        fail("PACKET_RX_RING");
+    }
+
+    this->_map_size = static_cast<size_t>(options.block_size) * options.block_count;
+    void* map = mmap(nullptr, this->_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, this->_fd, 0);
+    if (map == MAP_FAILED) {
+        // Locking is only to keep the ring out of swap, over RLIMIT_MEMLOCK it's fine without
+        map = mmap(nullptr, this->_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, this->_fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        this->_map = nullptr;
+        fail("mmap");
+    }
+    this->_map = static_cast<uint8_t*>(map);
+
+    this->_stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (this->_stop_fd < 0) {
+        fail("eventfd");
+    }
+
+    sockaddr_ll address {};
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(ETH_P_ALL);
+    if (bind(this->_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        fail("bind");
+    }
+}
+
+Ring::~Ring() {
+    this->_close();
+}
+
+void Ring::_close() {
+    if (this->_map) {
+        munmap(this->_map, this->_map_size);
+        this->_map = nullptr;
+    }
+    if (this->_fd >= 0) {
+        close(this->_fd);
+        this->_fd = -1;
+    }
+    if (this->_stop_fd >= 0) {
+        close(this->_stop_fd);
+        this->_stop_fd = -1;
+    }
+}
+
+bool Ring::poll(int timeout_ms, const std::function<void(const Frame&)>& handler) {
+    auto blockAt = [this](uint32_t index) {
+        return reinterpret_cast<tpacket_block_desc*>(this->_map + static_cast<size_t>(index) * this->_options.block_size);
+    };
+    auto ready = [](tpacket_block_desc* block) {
+        return __atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER;
+    };
+
+    if (!ready(blockAt(this->_block))) {
+        pollfd fds[2] = {
+            { this->_fd, POLLIN | POLLERR, 0 },
+            { this->_stop_fd, POLLIN, 0 },
+        };
+        if (::poll(fds, 2, timeout_ms) < 0 && errno != EINTR) {
+            return false;
+        }
+        if (this->_stopped) {
+            return false;
+        }
+    }
+
+    // Every block the kernel is done with, in order
+    for (auto* block = blockAt(this->_block); ready(block); block = blockAt(this->_block)) {
+        auto* packet = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(block) + block->hdr.bh1.offset_to_first_pkt);
+
+        for (uint32_t i = 0; i < block->hdr.bh1.num_pkts; i++) {
+            auto* link = reinterpret_cast<const sockaddr_ll*>(reinterpret_cast<uint8_t*>(packet) + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+
+            Frame frame;
+            frame.timestamp_ns = static_cast<int64_t>(packet->tp_sec) * 1'000'000'000 + packet->tp_nsec;
+            frame.outgoing = link->sll_pkttype == PACKET_OUTGOING;
+            frame.interface_index = link->sll_ifindex;
+            frame.data = reinterpret_cast<const uint8_t*>(packet) + packet->tp_net;
+            frame.length = packet->tp_snaplen;
+            frame.original_length = packet->tp_len;
+            handler(frame);
+
+            packet = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(packet) + packet->tp_next_offset);
+        }
+
+        // Back to the kernel
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        this->_block = (this->_block + 1) % this->_options.block_count;
+    }
+
+    return !this->_stopped;
+}
+
+void Ring::stop() {
+    this->_stopped = true;
+
+    // Never read, so every poll after this one returns at once too
+    uint64_t one = 1;
+    if (write(this->_stop_fd, &one, sizeof(one)) < 0) {
+        // Only fails if the counter would overflow, it's stopped either way
+    }
+}
+
+bool Ring::setFilter(const Filter& filter) {
+    sock_fprog program {};
+    program.len = static_cast<unsigned short>(filter.size());
+    program.filter = const_cast<sock_filter*>(filter.data());
+    return setsockopt(this->_fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) == 0;
+}
+
+uint32_t Ring::takeDrops() {
+    tpacket_stats_v3 statistics {};
+    socklen_t length = sizeof(statistics);
+    if (getsockopt(this->_fd, SOL_PACKET, PACKET_STATISTICS, &statistics, &length) != 0) {
+        return 0;
+    }
+    return statistics.tp_drops;
+}
+
+} // namespace platform::capture
+
+#endif // DROPSHIP_LINUX
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace platform::connections {
+
+struct Connection {
+    // IPPROTO_UDP or IPPROTO_TCP
+    int protocol = 0;
+    std::string remote_address;
+    uint16_t remote_port = 0;
+};
+
+// Find a running process by name (as in /proc/<pid>/comm, eg. "Overwatch.exe")
+// last is the pid found before, checked first so a process that's still running costs one read
+std::optional<int> findProcess(const std::string& name, std::optional<int> last = std::nullopt);
+
+// The cgroup v2 path of a process, as in /proc/<pid>/cgroup (eg. "/user.slice/.../app-steam.scope")
+// Nullopt if it's gone, or the box only has cgroup v1
+std::optional<std::string> getProcessCgroup(int pid);
+
+// Sockets of a process that have a remote address (connected udp, established tcp)
+// v4 remotes of dual stack sockets are given as v4 addresses
+// Listing tcp walks every tcp socket on the box, the slow part on a busy one. Connected udp sockets are few
+std::vector<Connection> getProcessConnections(int pid, bool tcp = true);
+
+} // namespace platform::connections
@@ -0,0 +1,332 @@
+// Linux process connection lookup using sock_diag
+// Falls back to the procfs tables when the kernel has no inet_diag or udp_diag
+
+#include "connections.h"
+#include "../platform.h"
+
+#if DROPSHIP_LINUX
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
+
+namespace platform::connections {
+
+namespace {
+    constexpr const char* TCP_ESTABLISHED_HEX = "01";
+
+    // A socket with a remote address, owned by the user the process runs as
+    // The address is printed only if the process turns out to own it
+    struct Candidate {
+        unsigned long inode = 0;
+        int protocol = 0;
+        bool v6 = false;
+        uint32_t address[4] {};
+        uint16_t port = 0;
+    };
+
+    // Socket inodes the last process read was found to own, and ones of the same user it didn't
+    // Inodes aren't reused, so a known one needs no new look at the fds
+    std::mutex ownersMutex;
+    int ownersPid = 0;
+    std::unordered_set<unsigned long> owned;
+    std::unordered_set<unsigned long> foreign;
+
+    // Socket inodes owned by a process, from /proc/<pid>/fd/* -> "socket:[inode]"
+    // A game has hundreds of fds, so this stays on readdir and readlinkat
+    std::unordered_set<unsigned long> getSocketInodes(int pid) {
+        std::unordered_set<unsigned long> inodes;
+
+        const auto fdPath = "/proc/" + std::to_string(pid) + "/fd";
+        DIR* directory = opendir(fdPath.c_str());
+        if (!directory) {
+            return inodes;
+        }
+
+        char target[64];
+        while (auto* entry = readdir(directory)) {
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+
+            ssize_t length = readlinkat(dirfd(directory), entry->d_name, target, sizeof(target) - 1);
+            if (length <= 8 || std::strncmp(target, "socket:[", 8) != 0) {
+                continue;
+            }
+            target[length] = '\0';
+            inodes.insert(std::strtoul(target + 8, nullptr, 10));
+        }
+
+        closedir(directory);
+        return inodes;
+    }
+
+    // Network-order words, as sock_diag has them. A dual stack socket talking to a v4 server
+    // has it as ::ffff:a.b.c.d, which is printed as the v4 address the catalog knows
+    std::string formatAddress(const uint32_t* words, bool v6) {
+        char buffer[INET6_ADDRSTRLEN] {};
+
+        if (v6 && IN6_IS_ADDR_V4MAPPED(reinterpret_cast<const in6_addr*>(words))) {
+            words += 3;
+            v6 = false;
+        }
+
+        if (!inet_ntop(v6 ? AF_INET6 : AF_INET, words, buffer, sizeof(buffer))) {
+            return {};
+        }
+        return buffer;
+    }
+
+    // Kernel prints addresses as native-endian 32 bit words of the network-order bytes
+    bool parseAddress(const std::string& hex, bool v6, uint32_t* words) {
+        const size_t count = v6 ? 4 : 1;
+
+        if (hex.size() != count * 8) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            words[i] = static_cast<uint32_t>(std::strtoul(hex.substr(i * 8, 8).c_str(), nullptr, 16));
+        }
+
+        return true;
+    }
+
+    // Dump the sockets of one family and protocol with a remote address, and keep the ones of uid
+    // Connected udp sockets are in the established state too, so the kernel leaves out every other socket
+    // Returns false if the kernel can't dump them, ex. udp_diag isn't loaded
+    bool dumpTable(int fd, uint8_t family, uint8_t protocol, uid_t uid, std::vector<Candidate>& result) {
+        struct {
+            nlmsghdr header;
+            inet_diag_req_v2 body;
+        } request {};
+
+        request.header.nlmsg_len = sizeof(request);
+        request.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+        request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        request.header.nlmsg_seq = family << 8 | protocol;
+        request.body.sdiag_family = family;
+        request.body.sdiag_protocol = protocol;
+        request.body.idiag_states = 1 << TCP_ESTABLISHED;
+
+        if (send(fd, &request, sizeof(request), 0) < 0) {
+            return false;
+        }
+
+        // The kernel fills up to 32k per read, a hundred bytes or so per socket
+        alignas(nlmsghdr) std::array<char, 32768> buffer;
+
+        while (true) {
+            ssize_t length = recv(fd, buffer.data(), buffer.size(), 0);
+            if (length <= 0) {
+                return false;
+            }
+
+            for (auto* message = reinterpret_cast<nlmsghdr*>(buffer.data());
+                 NLMSG_OK(message, static_cast<unsigned int>(length));
+                 message = NLMSG_NEXT(message, length)) {
+                if (message->nlmsg_type == NLMSG_DONE) {
+                    return true;
+                }
+                if (message->nlmsg_type == NLMSG_ERROR) {
+                    return false;
+                }
+
+                auto* info = static_cast<inet_diag_msg*>(NLMSG_DATA(message));
+                if (info->idiag_uid != uid || info->id.idiag_dport == 0) {
+                    continue;
+                }
+
+                Candidate candidate;
+                candidate.inode = info->idiag_inode;
+                candidate.protocol = protocol;
+                candidate.v6 = family == AF_INET6;
+                std::memcpy(candidate.address, info->id.idiag_dst, sizeof(candidate.address));
+                candidate.port = ntohs(info->id.idiag_dport);
+
+                result.push_back(candidate);
+            }
+        }
+    }
+
+    // Parse /proc/<pid>/net/{udp,tcp}{,6} for sockets of uid
+    void readTable(int pid, const char* table, int protocol, bool v6, uid_t uid, std::vector<Candidate>& result) {
+        std::ifstream file(std::filesystem::path("/proc") / std::to_string(pid) / "net" / table);
+        std::string line;
+
+        // Header
+        std::getline(file, line);
+
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string sl, local, remote, state, queues, timer, retransmits, timeout;
+            unsigned long owner = 0;
+            unsigned long inode = 0;
+
+            if (!(fields >> sl >> local >> remote >> state >> queues >> timer >> retransmits >> owner >> timeout >> inode)) {
+                continue;
+            }
+            if (owner != uid) {
+                continue;
+            }
+            if (protocol == IPPROTO_TCP && state != TCP_ESTABLISHED_HEX) {
+                continue;
+            }
+
+            auto colon = remote.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+
+            Candidate candidate;
+            candidate.inode = inode;
+            candidate.protocol = protocol;
+            candidate.v6 = v6;
+            candidate.port = static_cast<uint16_t>(std::strtoul(remote.c_str() + colon + 1, nullptr, 16));
+
+            // Unconnected udp sockets have no remote
+            if (candidate.port == 0 || !parseAddress(remote.substr(0, colon), v6, candidate.address)) {
+                continue;
+            }
+
+            result.push_back(candidate);
+        }
+    }
+}
+
+std::optional<int> findProcess(const std::string& name, std::optional<int> last) {
+    std::error_code ec;
+
+    // Still running, no need to look through every process
+    if (last) {
+        std::ifstream comm(std::filesystem::path("/proc") / std::to_string(last.value()) / "comm");
+        std::string processName;
+        if (std::getline(comm, processName) && processName == name) {
+            return last;
+        }
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator("/proc", ec)) {
+        const auto pid = entry.path().filename().string();
+        if (pid.empty() || pid.find_first_not_of("0123456789") != std::string::npos) {
+            continue;
+        }
+
+        std::ifstream comm(entry.path() / "comm");
+        std::string processName;
+        if (std::getline(comm, processName) && processName == name) {
+            return std::stoi(pid);
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<std::string> getProcessCgroup(int pid) {
+    std::ifstream cgroup(std::filesystem::path("/proc") / std::to_string(pid) / "cgroup");
+
+    // The unified hierarchy is the one with id 0 and no controllers
+    std::string line;
+    while (std::getline(cgroup, line)) {
+        if (line.starts_with("0::") && line.size() > 3) {
+            return line.substr(3);
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::vector<Connection> getProcessConnections(int pid, bool tcp) {
+    std::vector<Connection> result;
+
+    struct stat process {};
+    if (stat(("/proc/" + std::to_string(pid)).c_str(), &process) != 0) {
+        return result;
+    }
+
+    struct Table {
+        const char* name;
+        uint8_t family;
+        uint8_t protocol;
+    };
+    constexpr Table tables[] = {
+        { "udp", AF_INET, IPPROTO_UDP },
+        { "udp6", AF_INET6, IPPROTO_UDP },
+        { "tcp", AF_INET, IPPROTO_TCP },
+        { "tcp6", AF_INET6, IPPROTO_TCP },
+    };
+
+    // Sockets are in the netns of the process, which is ours unless it's sandboxed
+    std::vector<Candidate> candidates;
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+
+    for (const auto& table : tables) {
+        if (table.protocol == IPPROTO_TCP && !tcp) {
+            continue;
+        }
+
+        const size_t before = candidates.size();
+        if (fd >= 0 && dumpTable(fd, table.family, table.protocol, process.st_uid, candidates)) {
+            continue;
+        }
+
+        // A failed dump may have added some, the table has all of them
+        candidates.resize(before);
+        readTable(pid, table.name, table.protocol, table.family == AF_INET6, process.st_uid, candidates);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    std::lock_guard lock(ownersMutex);
+
+    if (ownersPid != pid) {
+        ownersPid = pid;
+        owned.clear();
+        foreign.clear();
+    }
+
+    // Reading the fds is most of the cost, and only a new socket needs it
+    const bool unknown = std::any_of(candidates.begin(), candidates.end(), [](const Candidate& candidate) {
+        return !owned.contains(candidate.inode) && !foreign.contains(candidate.inode);
+    });
+    if (unknown) {
+        owned = getSocketInodes(pid);
+        foreign.clear();
+    }
+
+    for (const auto& candidate : candidates) {
+        if (owned.contains(candidate.inode)) {
+            Connection connection;
+            connection.protocol = candidate.protocol;
+            connection.remote_address = formatAddress(candidate.address, candidate.v6);
+            connection.remote_port = candidate.port;
+            result.push_back(connection);
+        } else {
+            foreign.insert(candidate.inode);
+        }
+    }
+
+    return result;
+}
+
+} // namespace platform::connections
+
+#endif // DROPSHIP_LINUX
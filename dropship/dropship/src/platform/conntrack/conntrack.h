@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace platform::conntrack {
+
+// A udp flow conntrack started tracking, or stopped (it ended or timed out)
+// Addresses are of the first packet, so for a flow this machine opened the destination is the remote
+struct Event {
+    bool created = false;
+
+    std::string source_address;
+    uint16_t source_port = 0;
+    std::string destination_address;
+    uint16_t destination_port = 0;
+};
+
+// Called from the monitor thread, for every event
+using EventCallback = std::function<void(const Event&)>;
+
+// Subscribe to ctnetlink new and destroy events. A filter in the kernel drops everything but udp,
+// so the rest of the box's traffic never wakes the thread
+// Needs CAP_NET_ADMIN. Conntrack only tracks flows once something uses it (a stateful rule, nat),
+// so a monitor that started may still never see an event
+bool startMonitor(EventCallback callback);
+
+// Stop the monitor thread
+void stopMonitor();
+
+} // namespace platform::conntrack
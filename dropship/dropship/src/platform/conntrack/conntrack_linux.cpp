@@ -0,0 +1,247 @@
+// Linux conntrack event monitor using ctnetlink
+// Says when a udp flow starts or ends as it happens, instead of polling the sockets
+
+#include "conntrack.h"
+#include "../platform.h"
+
+#if DROPSHIP_LINUX
+
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/netlink.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_conntrack.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <mutex>
+
+namespace platform::conntrack {
+
+namespace {
+    constexpr unsigned int MONITOR_GROUPS = (1 << (NFNLGRP_CONNTRACK_NEW - 1)) | (1 << (NFNLGRP_CONNTRACK_DESTROY - 1));
+
+    // Attributes start after the netlink and nfnetlink headers
+    constexpr uint32_t ATTRIBUTES_OFFSET = NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(nfgenmsg));
+
+    // Ancillary loads: offset of the attribute of type X, from the one at A or nested in the one at A. 0 if there's none
+    constexpr uint32_t LOAD_ATTRIBUTE = static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_NLATTR);
+    constexpr uint32_t LOAD_NESTED_ATTRIBUTE = static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_NLATTR_NEST);
+
+    // Monitor state
+    std::mutex monitorMutex;
+    std::future<void> monitorFuture;
+    int stopFd = -1;
+
+    // Keeps events whose original tuple is udp. The kernel walks the nested attributes itself,
+    // orig -> proto -> protocol number
+    bool attachFilter(int fd) {
+        constexpr uint32_t DROP = 14;
+        std::array<sock_filter, 15> program {{
+            BPF_STMT(BPF_LD | BPF_W | BPF_IMM, ATTRIBUTES_OFFSET),
+            BPF_STMT(BPF_LDX | BPF_W | BPF_IMM, CTA_TUPLE_ORIG),
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, LOAD_ATTRIBUTE),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, DROP - 4, 0),
+            BPF_STMT(BPF_LDX | BPF_W | BPF_IMM, CTA_TUPLE_PROTO),
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, LOAD_NESTED_ATTRIBUTE),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, DROP - 7, 0),
+            BPF_STMT(BPF_LDX | BPF_W | BPF_IMM, CTA_PROTO_NUM),
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, LOAD_NESTED_ATTRIBUTE),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, DROP - 10, 0),
+            BPF_STMT(BPF_MISC | BPF_TAX, 0),
+            BPF_STMT(BPF_LD | BPF_B | BPF_IND, NLA_HDRLEN),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 1),
+            BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+            BPF_STMT(BPF_RET | BPF_K, 0),
+        }};
+
+        sock_fprog fprog {};
+        fprog.len = static_cast<unsigned short>(program.size());
+        fprog.filter = program.data();
+        return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) == 0;
+    }
+
+    int openSocket() {
+        int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER);
+        if (fd < 0) {
+            return -1;
+        }
+
+        // Before the bind, or events of other protocols could already be queued
+        if (!attachFilter(fd)) {
+            close(fd);
+            return -1;
+        }
+
+        // Joining conntrack's groups needs CAP_NET_ADMIN
+        sockaddr_nl addr {};
+        addr.nl_family = AF_NETLINK;
+        addr.nl_groups = MONITOR_GROUPS;
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    // Call handler with the type and payload of every attribute in data
+    template<typename Handler>
+    void forEachAttribute(const uint8_t* data, size_t length, Handler&& handler) {
+        while (length >= NLA_HDRLEN) {
+            nlattr attribute;
+            std::memcpy(&attribute, data, sizeof(attribute));
+            if (attribute.nla_len < NLA_HDRLEN || attribute.nla_len > length) {
+                return;
+            }
+
+            handler(attribute.nla_type & NLA_TYPE_MASK, data + NLA_HDRLEN, attribute.nla_len - NLA_HDRLEN);
+
+            const size_t aligned = NLA_ALIGN(attribute.nla_len);
+            if (aligned >= length) {
+                return;
+            }
+            data += aligned;
+            length -= aligned;
+        }
+    }
+
+    std::string formatAddress(int family, const uint8_t* data) {
+        char text[INET6_ADDRSTRLEN] {};
+        inet_ntop(family, data, text, sizeof(text));
+        return text;
+    }
+
+    // The original tuple of a new or destroy message, false if it isn't complete
+    bool parseEvent(const nlmsghdr* message, Event& event) {
+        const auto type = NFNL_MSG_TYPE(message->nlmsg_type);
+        if (type != IPCTNL_MSG_CT_NEW && type != IPCTNL_MSG_CT_DELETE) {
+            return false;
+        }
+        if (message->nlmsg_len < ATTRIBUTES_OFFSET) {
+            return false;
+        }
+
+        event = {};
+        event.created = type == IPCTNL_MSG_CT_NEW;
+
+        const auto* base = reinterpret_cast<const uint8_t*>(message);
+        bool source = false;
+        bool destination = false;
+
+        forEachAttribute(base + ATTRIBUTES_OFFSET, message->nlmsg_len - ATTRIBUTES_OFFSET, [&](uint16_t type, const uint8_t* data, size_t length) {
+            if (type != CTA_TUPLE_ORIG) {
+                return;
+            }
+
+            forEachAttribute(data, length, [&](uint16_t type, const uint8_t* data, size_t length) {
+                if (type == CTA_TUPLE_IP) {
+                    forEachAttribute(data, length, [&](uint16_t type, const uint8_t* data, size_t length) {
+                        if ((type == CTA_IP_V4_SRC || type == CTA_IP_V4_DST) && length >= 4) {
+                            (type == CTA_IP_V4_SRC ? event.source_address : event.destination_address) = formatAddress(AF_INET, data);
+                            (type == CTA_IP_V4_SRC ? source : destination) = true;
+                        } else if ((type == CTA_IP_V6_SRC || type == CTA_IP_V6_DST) && length >= 16) {
+                            (type == CTA_IP_V6_SRC ? event.source_address : event.destination_address) = formatAddress(AF_INET6, data);
+                            (type == CTA_IP_V6_SRC ? source : destination) = true;
+                        }
+                    });
+                } else if (type == CTA_TUPLE_PROTO) {
+                    forEachAttribute(data, length, [&](uint16_t type, const uint8_t* data, size_t length) {
+                        uint16_t port = 0;
+                        if ((type == CTA_PROTO_SRC_PORT || type == CTA_PROTO_DST_PORT) && length >= sizeof(port)) {
+                            std::memcpy(&port, data, sizeof(port));
+                            (type == CTA_PROTO_SRC_PORT ? event.source_port : event.destination_port) = ntohs(port);
+                        }
+                    });
+                }
+            });
+        });
+
+        return source && destination;
+    }
+}
+
+bool startMonitor(EventCallback callback) {
+    std::lock_guard lock(monitorMutex);
+
+    if (monitorFuture.valid()) {
+        return true;
+    }
+
+    int eventsFd = openSocket();
+    stopFd = eventfd(0, EFD_CLOEXEC);
+
+    if (eventsFd < 0 || stopFd < 0) {
+        if (eventsFd >= 0) close(eventsFd);
+        if (stopFd >= 0) close(stopFd);
+        stopFd = -1;
+        return false;
+    }
+
+    monitorFuture = std::async(std::launch::async, [eventsFd, callback = std::move(callback)] {
+        std::array<pollfd, 2> fds {{
+            { eventsFd, POLLIN, 0 },
+            { stopFd, POLLIN, 0 },
+        }};
+
+        alignas(nlmsghdr) std::array<char, 16384> buffer;
+        Event event;
+
+        while (true) {
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+
+            if (fds[1].revents & POLLIN) {
+                break;
+            }
+
+            // A burst of flows can overrun the socket (ENOBUFS). Those events are gone, carry on with the next
+            ssize_t length = recv(eventsFd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+            if (length <= 0) {
+                continue;
+            }
+
+            for (auto* message = reinterpret_cast<nlmsghdr*>(buffer.data());
+                 NLMSG_OK(message, static_cast<unsigned int>(length));
+                 message = NLMSG_NEXT(message, length)) {
+                if (parseEvent(message, event)) {
+                    callback(event);
+                }
+            }
+        }
+
+        close(eventsFd);
+    });
+
+    return true;
+}
+
+void stopMonitor() {
+    std::lock_guard lock(monitorMutex);
+
+    if (!monitorFuture.valid()) {
+        return;
+    }
+
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t written = write(stopFd, &one, sizeof(one));
+    monitorFuture.get();
+
+    close(stopFd);
+    stopFd = -1;
+}
+
+} // namespace platform::conntrack
+
+#endif // DROPSHIP_LINUX
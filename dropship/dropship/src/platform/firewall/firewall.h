@@ -11,7 +11,7 @@ struct FirewallRule {
     std::string name;
     std::string group;
     std::string description;
-    std::vector<std::string> blocked_addresses; // CIDR notation
+    std::vector<std::string> blocked_addresses; // CIDR notation, both families
     bool enabled = false;
 };
 
@@ -43,4 +43,46 @@ bool deleteRule(const std::string& name);
 void forEachRuleInGroup(const std::string& group, 
                         std::function<void(const FirewallRule&)> callback);
 
+// Put back what this process added: the ipsets, our chains and their rules, and the OUTPUT jumps
+// Network managers may reload the firewall when networks change, flushing all of it
+// Only what's missing is re-created. False if any of it couldn't be
+bool validateRules();
+
+// DSCP class used when marking game traffic
+// EF is paired with socket priority 6 (WMM voice), CS4 with 5 (WMM video)
+enum class DscpClass {
+    EF,
+    CS4,
+};
+
+// Mark outbound UDP to the given addresses (CIDR notation, both families)
+// with a DSCP class and the matching socket priority.
+// Addresses are loaded into one ipset per family, so this is a single
+// marking rule per family regardless of how many prefixes are passed.
+// If cgroup is set (cgroup v2 path), only that cgroup's traffic is marked
+// A cgroup path with a quote, $, ` or \ in it is refused
+bool setPriorityMarking(const std::vector<std::string>& addresses,
+                        DscpClass dscp,
+                        const std::optional<std::string>& cgroup = std::nullopt);
+
+// Remove priority marking rules and sets
+bool clearPriorityMarking();
+
+// Allow-list mode: drop all UDP from the cgroup (the game) except to the
+// given addresses (CIDR notation, both families). Unlike the block list this
+// also catches servers that are not in the catalog yet.
+// Implemented as one set lookup and one drop rule per family.
+// Loopback, private, carrier-grade nat (100.64.0.0/10, eg. tailscale),
+// link-local, multicast and broadcast ranges and DNS (udp/53) are always allowed.
+// Everything else the cgroup sends over UDP is dropped too: voice chat and
+// other Blizzard services outside the catalog, STUN, NTP, and QUIC, which
+// falls back to TCP. A launcher cgroup (eg. Steam's scope) loses its own UDP.
+// Refuses to enable with no addresses, or with no cgroup or the root one,
+// since that would drop every UDP packet on the machine. The cgroup path is
+// refused like setPriorityMarking's
+bool setAllowList(const std::vector<std::string>& addresses, const std::string& cgroup);
+
+// Disable allow-list mode
+bool clearAllowList();
+
 } // namespace platform::firewall
@@ -12,7 +12,11 @@
 #include <sstream>
 #include <filesystem>
 #include <array>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
 
 namespace platform::firewall {
 
@@ -20,6 +24,42 @@ namespace {
     // Chain prefix for dropship rules
     constexpr const char* CHAIN_PREFIX = "DROPSHIP_";
     
+    // Set prefix for dropship ipsets
+    constexpr const char* SET_PREFIX = "dropship_";
+    
+    // Mangle chains for priority marking
+    // The mark chain applies DSCP and socket priority to whatever jumps into it
+    constexpr const char* PRIORITY_CHAIN = "DROPSHIP_PRIORITY";
+    constexpr const char* PRIORITY_MARK_CHAIN = "DROPSHIP_PRIORITY_MARK";
+    constexpr const char* PRIORITY_SET = "priority";
+    
+    // Filter chain for allow-list mode
+    constexpr const char* ALLOWLIST_CHAIN = "DROPSHIP_ALLOWLIST";
+    constexpr const char* ALLOWLIST_SET = "allow";
+    
+    // Always reachable in allow-list mode (lan, local resolvers, multicast and broadcast discovery)
+    // 100.64.0.0/10 is carrier-grade nat, also used by overlay vpns like tailscale and some isps' resolvers
+    constexpr std::array<const char*, 12> LOCAL_ADDRESSES {
+        "10.0.0.0/8",
+        "100.64.0.0/10",
+        "127.0.0.0/8",
+        "169.254.0.0/16",
+        "172.16.0.0/12",
+        "192.168.0.0/16",
+        "224.0.0.0/4",
+        "255.255.255.255/32",
+        "::1/128",
+        "fc00::/7",
+        "fe80::/10",
+        "ff00::/8",
+    };
+    
+    // Firewall tool and ipset suffix for each address family
+    constexpr std::array<std::pair<const char*, const char*>, 2> FAMILIES {{
+        { "iptables", "4" },
+        { "ip6tables", "6" },
+    }};
+    
     // Execute a shell command and return success/failure
     bool executeCommand(const std::string& cmd) {
         int result = std::system(cmd.c_str());
@@ -40,10 +80,156 @@ namespace {
         return result;
     }
     
+    // Execute a command, writing input to its stdin
+    bool executeCommandWithInput(const std::string& cmd, const std::string& input) {
+        FILE* pipe = popen(cmd.c_str(), "w");
+        if (!pipe) {
+            return false;
+        }
+        fwrite(input.data(), 1, input.size(), pipe);
+        return pclose(pipe) == 0;
+    }
+    
     // Check if running as root
     bool isRoot() {
         return geteuid() == 0;
     }
+    
+    bool isIPv6(const std::string& addr) {
+        return addr.find(':') != std::string::npos;
+    }
+    
+    // Cgroup paths go into a shell command inside double quotes, where these still mean something
+    bool isSafeCgroupPath(const std::string& path) {
+        return !path.empty() && path.find_first_of("\"$`\\\n") == std::string::npos;
+    }
+    
+    // What this process has put in the firewall, so validateRules can put it back
+    // Network managers may flush every table (and destroy the sets with them) when networks change
+    // Public functions hold the mutex throughout, so a validation never sees a change half made
+    std::mutex stateMutex;
+    
+    // Set name (without prefix and family) -> addresses of both families
+    std::map<std::string, std::vector<std::string>> addressSets;
+    
+    // Our chains as (tool with table, chain) -> their rules in order, in the order they were created
+    // A chain is created before the chains whose rules jump to it
+    std::vector<std::pair<std::pair<std::string, std::string>, std::vector<std::string>>> chains;
+    
+    // OUTPUT jumps we have added, as (tool with table, chain)
+    std::set<std::pair<std::string, std::string>> jumps;
+    
+    // Fill "<prefix><name>4" and "<prefix><name>6" with the given addresses
+    // Everything goes through one ipset restore, and each set is filled as a temporary
+    // then swapped in, so rules matching the set never see it half loaded
+    bool writeAddressSets(const std::string& name, const std::vector<std::string>& addresses) {
+        std::string script;
+        
+        for (const auto& [tool, suffix] : FAMILIES) {
+            const bool v6 = std::string(suffix) == "6";
+            const std::string family = v6 ? "inet6" : "inet";
+            const std::string set = SET_PREFIX + name + suffix;
+            const std::string tmp = set + "_tmp";
+            
+            script += "create " + set + " hash:net family " + family + " -exist\n";
+            script += "create " + tmp + " hash:net family " + family + " -exist\n";
+            script += "flush " + tmp + "\n";
+            for (const auto& addr : addresses) {
+                if (isIPv6(addr) == v6) {
+                    script += "add " + tmp + " " + addr + " -exist\n";
+                }
+            }
+            script += "swap " + tmp + " " + set + "\n";
+            script += "destroy " + tmp + "\n";
+        }
+        
+        return executeCommandWithInput("ipset restore", script);
+    }
+    
+    // Replace the contents of a set pair and remember them
+    bool loadAddressSets(const std::string& name, const std::vector<std::string>& addresses) {
+        addressSets[name] = addresses;
+        return writeAddressSets(name, addresses);
+    }
+    
+    void destroyAddressSets(const std::string& name) {
+        addressSets.erase(name);
+        for (const auto& [tool, suffix] : FAMILIES) {
+            executeCommand(std::string("ipset destroy ") + SET_PREFIX + name + suffix + " 2>/dev/null");
+        }
+    }
+    
+    std::vector<std::string>& chainRules(const std::string& tool, const std::string& chain) {
+        for (auto& [key, rules] : chains) {
+            if (key.first == tool && key.second == chain) {
+                return rules;
+            }
+        }
+        return chains.emplace_back(std::make_pair(tool, chain), std::vector<std::string>()).second;
+    }
+    
+    // Create chain if it doesn't exist, and make rules its only contents
+    bool writeChain(const std::string& tool, const std::string& chain, const std::vector<std::string>& rules) {
+        executeCommand(tool + " -N " + chain + " 2>/dev/null");
+        if (!executeCommand(tool + " -F " + chain)) {
+            return false;
+        }
+        for (const auto& rule : rules) {
+            if (!executeCommand(tool + " -A " + chain + " " + rule)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // Replace the rules of a chain and remember them
+    bool setChain(const std::string& tool, const std::string& chain, const std::vector<std::string>& rules) {
+        chainRules(tool, chain) = rules;
+        return writeChain(tool, chain, rules);
+    }
+    
+    // Add a rule to the end of a chain, creating it if needed
+    bool appendToChain(const std::string& tool, const std::string& chain, const std::string& rule) {
+        chainRules(tool, chain).push_back(rule);
+        executeCommand(tool + " -N " + chain + " 2>/dev/null");
+        return executeCommand(tool + " -A " + chain + " " + rule);
+    }
+    
+    void removeChain(const std::string& tool, const std::string& chain) {
+        std::erase_if(chains, [&](const auto& c) { return c.first.first == tool && c.first.second == chain; });
+        executeCommand(tool + " -F " + chain + " 2>/dev/null");
+        executeCommand(tool + " -X " + chain + " 2>/dev/null");
+    }
+    
+    // Whether chain exists with as many rules as we gave it. Flushes and reloads leave it empty or gone
+    bool isChainIntact(const std::string& tool, const std::string& chain, const std::vector<std::string>& rules) {
+        std::istringstream listing(executeCommandWithOutput(tool + " -S " + chain + " 2>/dev/null"));
+        
+        bool exists = false;
+        size_t count = 0;
+        std::string line;
+        while (std::getline(listing, line)) {
+            exists = exists || line.starts_with("-N ");
+            count += line.starts_with("-A ");
+        }
+        return exists && count == rules.size();
+    }
+    
+    // Add a jump to chain from OUTPUT if not present
+    bool writeOutputJump(const std::string& tool, const std::string& chain) {
+        return executeCommand(tool + " -C OUTPUT -j " + chain + " 2>/dev/null || " +
+                              tool + " -A OUTPUT -j " + chain);
+    }
+    
+    bool addOutputJump(const std::string& tool, const std::string& chain) {
+        jumps.insert({ tool, chain });
+        return writeOutputJump(tool, chain);
+    }
+    
+    bool removeOutputJump(const std::string& tool, const std::string& chain) {
+        jumps.erase({ tool, chain });
+        return executeCommand(tool + " -D OUTPUT -j " + chain + " 2>/dev/null");
+    }
 }
 
 bool initialize() {
@@ -82,19 +268,21 @@ bool createRule(const FirewallRule& rule) {
         return false;
     }
     
+    std::lock_guard lock(stateMutex);
     std::string chainName = CHAIN_PREFIX + rule.group;
     
-    // Create chain if it doesn't exist
-    executeCommand("iptables -N " + chainName + " 2>/dev/null");
-    
-    // Add jump to our chain from OUTPUT
-    executeCommand("iptables -C OUTPUT -j " + chainName + " 2>/dev/null || "
-                   "iptables -A OUTPUT -j " + chainName);
+    for (const auto& [tool, suffix] : FAMILIES) {
+        // Create chain if it doesn't exist
+        chainRules(tool, chainName);
+        executeCommand(std::string(tool) + " -N " + chainName + " 2>/dev/null");
+        
+        // Add jump to our chain from OUTPUT
+        addOutputJump(tool, chainName);
+    }
     
-    // Add rules for each blocked address
+    // Add rules for each blocked address, to the chain of its family
     for (const auto& addr : rule.blocked_addresses) {
-        std::string cmd = "iptables -A " + chainName + " -d " + addr + " -j DROP";
-        if (!executeCommand(cmd)) {
+        if (!appendToChain(isIPv6(addr) ? "ip6tables" : "iptables", chainName, "-d " + addr + " -j DROP")) {
             return false;
         }
     }
@@ -107,15 +295,21 @@ bool setRuleAddresses(const std::string& name, const std::vector<std::string>& a
         return false;
     }
     
+    std::lock_guard lock(stateMutex);
     std::string chainName = CHAIN_PREFIX + name;
     
-    // Flush existing rules in the chain
-    executeCommand("iptables -F " + chainName + " 2>/dev/null");
-    
-    // Add new rules
-    for (const auto& addr : addresses) {
-        std::string cmd = "iptables -A " + chainName + " -d " + addr + " -j DROP";
-        if (!executeCommand(cmd)) {
+    // Replace the rules in the chain of each family
+    for (const auto& [tool, suffix] : FAMILIES) {
+        const bool v6 = std::string(suffix) == "6";
+        
+        std::vector<std::string> rules;
+        for (const auto& addr : addresses) {
+            if (isIPv6(addr) == v6) {
+                rules.push_back("-d " + addr + " -j DROP");
+            }
+        }
+        
+        if (!setChain(tool, chainName, rules)) {
             return false;
         }
     }
@@ -128,16 +322,21 @@ bool setRuleEnabled(const std::string& name, bool enabled) {
         return false;
     }
     
+    std::lock_guard lock(stateMutex);
     std::string chainName = CHAIN_PREFIX + name;
     
-    if (enabled) {
-        // Add jump to chain if not present
-        return executeCommand("iptables -C OUTPUT -j " + chainName + " 2>/dev/null || "
-                              "iptables -A OUTPUT -j " + chainName);
-    } else {
-        // Remove jump to chain
-        return executeCommand("iptables -D OUTPUT -j " + chainName + " 2>/dev/null");
+    bool changed = true;
+    for (const auto& [tool, suffix] : FAMILIES) {
+        if (enabled) {
+            // Add jump to chain if not present
+            changed = addOutputJump(tool, chainName) && changed;
+        } else {
+            // Remove jump to chain
+            changed = removeOutputJump(tool, chainName) && changed;
+        }
     }
+    
+    return changed;
 }
 
 bool deleteRule(const std::string& name) {
@@ -145,14 +344,16 @@ bool deleteRule(const std::string& name) {
         return false;
     }
     
+    std::lock_guard lock(stateMutex);
     std::string chainName = CHAIN_PREFIX + name;
     
-    // Remove jump from OUTPUT
-    executeCommand("iptables -D OUTPUT -j " + chainName + " 2>/dev/null");
-    
-    // Flush and delete the chain
-    executeCommand("iptables -F " + chainName + " 2>/dev/null");
-    executeCommand("iptables -X " + chainName + " 2>/dev/null");
+    for (const auto& [tool, suffix] : FAMILIES) {
+        // Remove jump from OUTPUT
+        removeOutputJump(tool, chainName);
+        
+        // Flush and delete the chain
+        removeChain(tool, chainName);
+    }
     
     return true;
 }
@@ -165,6 +366,164 @@ void forEachRuleInGroup(const std::string& group,
     }
 }
 
+bool validateRules() {
+    if (!isRoot()) {
+        return false;
+    }
+    
+    std::lock_guard lock(stateMutex);
+    bool valid = true;
+    
+    // Sets first, rules can't refer to a set that's gone
+    std::set<std::string> existing;
+    {
+        std::istringstream listing(executeCommandWithOutput("ipset list -n 2>/dev/null"));
+        std::string line;
+        while (std::getline(listing, line)) {
+            existing.insert(line);
+        }
+    }
+    for (const auto& [name, addresses] : addressSets) {
+        for (const auto& [tool, suffix] : FAMILIES) {
+            if (!existing.contains(SET_PREFIX + name + suffix)) {
+                valid = writeAddressSets(name, addresses) && valid;
+                break;
+            }
+        }
+    }
+    
+    // Every chain exists before any is filled, since they jump to each other
+    for (const auto& [key, rules] : chains) {
+        executeCommand(key.first + " -N " + key.second + " 2>/dev/null");
+    }
+    for (const auto& [key, rules] : chains) {
+        if (!isChainIntact(key.first, key.second, rules)) {
+            valid = writeChain(key.first, key.second, rules) && valid;
+        }
+    }
+    
+    for (const auto& [tool, chain] : jumps) {
+        valid = writeOutputJump(tool, chain) && valid;
+    }
+    
+    return valid;
+}
+
+bool setPriorityMarking(const std::vector<std::string>& addresses,
+                        DscpClass dscp,
+                        const std::optional<std::string>& cgroup) {
+    if (!isRoot() || (cgroup && !isSafeCgroupPath(cgroup.value()))) {
+        return false;
+    }
+    
+    std::lock_guard lock(stateMutex);
+    if (!loadAddressSets(PRIORITY_SET, addresses)) {
+        return false;
+    }
+    
+    const std::string dscpClass = dscp == DscpClass::EF ? "EF" : "CS4";
+    const std::string priority = dscp == DscpClass::EF ? "0:6" : "0:5";
+    
+    std::string match = "-p udp";
+    if (cgroup) {
+        match += " -m cgroup --path \"" + cgroup.value() + "\"";
+    }
+    
+    for (const auto& [tool, suffix] : FAMILIES) {
+        const std::string mangle = std::string(tool) + " -t mangle";
+        
+        // The mark chain first, the other one jumps to it
+        // A single set lookup decides whether a packet is marked
+        const std::string set = SET_PREFIX + std::string(PRIORITY_SET) + suffix;
+        bool added = setChain(mangle, PRIORITY_MARK_CHAIN, {
+                "-j DSCP --set-dscp-class " + dscpClass,
+                "-j CLASSIFY --set-class " + priority,
+            })
+            && setChain(mangle, PRIORITY_CHAIN, {
+                match + " -m set --match-set " + set + " dst -j " + PRIORITY_MARK_CHAIN,
+            });
+        if (!added) {
+            return false;
+        }
+        
+        // Add jump to our chain from OUTPUT
+        addOutputJump(mangle, PRIORITY_CHAIN);
+    }
+    
+    return true;
+}
+
+bool clearPriorityMarking() {
+    if (!isRoot()) {
+        return false;
+    }
+    
+    std::lock_guard lock(stateMutex);
+    for (const auto& [tool, suffix] : FAMILIES) {
+        const std::string mangle = std::string(tool) + " -t mangle";
+        
+        removeOutputJump(mangle, PRIORITY_CHAIN);
+        removeChain(mangle, PRIORITY_CHAIN);
+        removeChain(mangle, PRIORITY_MARK_CHAIN);
+    }
+    
+    destroyAddressSets(PRIORITY_SET);
+    
+    return true;
+}
+
+bool setAllowList(const std::vector<std::string>& addresses, const std::string& cgroup) {
+    if (!isRoot()) {
+        return false;
+    }
+    
+    /* !important an empty set would drop all game traffic, and no cgroup (or the root one) would drop all udp */
+    if (addresses.empty() || !isSafeCgroupPath(cgroup) || cgroup == "/") {
+        return false;
+    }
+    
+    std::vector<std::string> allowed(LOCAL_ADDRESSES.begin(), LOCAL_ADDRESSES.end());
+    allowed.insert(allowed.end(), addresses.begin(), addresses.end());
+    
+    std::lock_guard lock(stateMutex);
+    if (!loadAddressSets(ALLOWLIST_SET, allowed)) {
+        return false;
+    }
+    
+    for (const auto& [tool, suffix] : FAMILIES) {
+        // Name lookups go to whatever resolver is configured, often a public one
+        const std::string set = SET_PREFIX + std::string(ALLOWLIST_SET) + suffix;
+        const std::string owner = " -m cgroup --path \"" + cgroup + "\"";
+        bool added = setChain(tool, ALLOWLIST_CHAIN, {
+            "-p udp --dport 53" + owner + " -j RETURN",
+            "-p udp" + owner + " -m set ! --match-set " + set + " dst -j DROP",
+        });
+        if (!added) {
+            return false;
+        }
+        
+        addOutputJump(tool, ALLOWLIST_CHAIN);
+    }
+    
+    return true;
+}
+
+bool clearAllowList() {
+    if (!isRoot()) {
+        return false;
+    }
+    
+    std::lock_guard lock(stateMutex);
+    for (const auto& [tool, suffix] : FAMILIES) {
+        removeOutputJump(tool, ALLOWLIST_CHAIN);
+        removeChain(tool, ALLOWLIST_CHAIN);
+    }
+    
+    destroyAddressSets(ALLOWLIST_SET);
+    
+    return true;
+}
+
 } // namespace platform::firewall
 
 #endif // DROPSHIP_LINUX
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <functional>
+
+namespace platform::network {
+
+struct NetworkInformation {
+    // Number of interfaces that are up and have a global address
+    // 2 or more may indicate a vpn
+    int connected_networks_count = 0;
+    
+    // A tunnel interface (tun, wireguard, ppp) is up
+    bool vpn_detected = false;
+    
+    // Interface carrying the default route, empty when offline
+    std::string default_interface;
+    
+    // Gateways of the default routes, and the default interface's global addresses
+    // A new network on the same interface changes these, eg. roaming or a new lease
+    // Temporary ipv6 addresses are left out, they rotate on their own
+    std::set<std::string> gateways;
+    std::set<std::string> addresses;
+    
+    bool operator==(const NetworkInformation&) const = default;
+};
+
+// Called from the monitor thread once per burst of link/address/route events
+using ChangeCallback = std::function<void(const NetworkInformation&)>;
+
+// Query the current network state over rtnetlink
+NetworkInformation queryNetwork();
+
+// Subscribe to rtnetlink link, address and route events
+// The callback only runs when the resulting NetworkInformation changed
+bool startMonitor(ChangeCallback callback);
+
+// Stop the monitor thread
+void stopMonitor();
+
+} // namespace platform::network
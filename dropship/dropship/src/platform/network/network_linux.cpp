@@ -0,0 +1,350 @@
+// Linux network monitor using rtnetlink
+// Replaces the polling done by Firewall::_queryNetworkStatus on Windows
+
+#include "network.h"
+#include "../platform.h"
+
+#if DROPSHIP_LINUX
+
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if.h>
+#include <linux/if_arp.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+
+namespace platform::network {
+
+namespace {
+    constexpr unsigned int MONITOR_GROUPS = RTMGRP_LINK |
+                                            RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR |
+                                            RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+
+    struct Link {
+        std::string name;
+        bool up = false;
+        bool tunnel = false;
+    };
+
+    // Monitor state
+    std::mutex monitorMutex;
+    std::future<void> monitorFuture;
+    int stopFd = -1;
+
+    int openSocket(unsigned int groups) {
+        int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (fd < 0) {
+            return -1;
+        }
+
+        sockaddr_nl addr {};
+        addr.nl_family = AF_NETLINK;
+        addr.nl_groups = groups;
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    // Send a dump request and call handler for every message in the reply
+    template<typename Handler>
+    bool dump(int fd, uint16_t type, uint8_t family, Handler&& handler) {
+        struct {
+            nlmsghdr header;
+            rtgenmsg body;
+        } request {};
+
+        request.header.nlmsg_len = sizeof(request);
+        request.header.nlmsg_type = type;
+        request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        request.header.nlmsg_seq = type;
+        request.body.rtgen_family = family;
+
+        if (send(fd, &request, sizeof(request), 0) < 0) {
+            return false;
+        }
+
+        alignas(nlmsghdr) std::array<char, 16384> buffer;
+
+        while (true) {
+            ssize_t length = recv(fd, buffer.data(), buffer.size(), 0);
+            if (length <= 0) {
+                return false;
+            }
+
+            for (auto* message = reinterpret_cast<nlmsghdr*>(buffer.data());
+                 NLMSG_OK(message, static_cast<unsigned int>(length));
+                 message = NLMSG_NEXT(message, length)) {
+                if (message->nlmsg_type == NLMSG_DONE) {
+                    return true;
+                }
+                if (message->nlmsg_type == NLMSG_ERROR) {
+                    return false;
+                }
+                handler(message);
+            }
+        }
+    }
+
+    std::string formatAddress(int family, const void* data) {
+        char text[INET6_ADDRSTRLEN] {};
+        inet_ntop(family, data, text, sizeof(text));
+        return text;
+    }
+
+    NetworkInformation query(int fd) {
+        std::map<int, Link> links;
+        std::map<int, std::set<std::string>> addressed;
+
+        // Links
+        dump(fd, RTM_GETLINK, AF_UNSPEC, [&links](nlmsghdr* message) {
+            auto* info = static_cast<ifinfomsg*>(NLMSG_DATA(message));
+            if (info->ifi_flags & IFF_LOOPBACK) {
+                return;
+            }
+
+            Link link;
+            link.up = (info->ifi_flags & IFF_UP) && (info->ifi_flags & IFF_RUNNING);
+            link.tunnel = (info->ifi_flags & IFF_POINTOPOINT) ||
+                          info->ifi_type == ARPHRD_NONE ||
+                          info->ifi_type == ARPHRD_PPP;
+
+            int length = IFLA_PAYLOAD(message);
+            for (auto* attr = IFLA_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length)) {
+                if (attr->rta_type == IFLA_IFNAME) {
+                    link.name = static_cast<const char*>(RTA_DATA(attr));
+                }
+            }
+
+            links[info->ifi_index] = link;
+        });
+
+        // Interfaces with a global address
+        dump(fd, RTM_GETADDR, AF_UNSPEC, [&addressed](nlmsghdr* message) {
+            auto* info = static_cast<ifaddrmsg*>(NLMSG_DATA(message));
+            if (info->ifa_scope != RT_SCOPE_UNIVERSE) {
+                return;
+            }
+
+            auto& addresses = addressed[static_cast<int>(info->ifa_index)];
+            if (info->ifa_flags & IFA_F_TEMPORARY) {
+                return;
+            }
+
+            int length = IFA_PAYLOAD(message);
+            for (auto* attr = IFA_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length)) {
+                if (attr->rta_type == IFA_ADDRESS) {
+                    addresses.insert(formatAddress(info->ifa_family, RTA_DATA(attr)));
+                }
+            }
+        });
+
+        NetworkInformation result;
+
+        // Default routes, any table. vpns often install theirs outside main
+        uint32_t bestMetric = UINT32_MAX;
+        int bestIndex = 0;
+        bool tunnelDefault = false;
+
+        auto routes = [&](nlmsghdr* message) {
+            auto* info = static_cast<rtmsg*>(NLMSG_DATA(message));
+            if (info->rtm_dst_len != 0 || info->rtm_type != RTN_UNICAST) {
+                return;
+            }
+
+            int oif = 0;
+            uint32_t metric = 0;
+            uint32_t table = info->rtm_table;
+            std::string gateway;
+
+            int length = RTM_PAYLOAD(message);
+            for (auto* attr = RTM_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length)) {
+                if (attr->rta_type == RTA_OIF) {
+                    oif = *static_cast<int*>(RTA_DATA(attr));
+                } else if (attr->rta_type == RTA_PRIORITY) {
+                    metric = *static_cast<uint32_t*>(RTA_DATA(attr));
+                } else if (attr->rta_type == RTA_TABLE) {
+                    table = *static_cast<uint32_t*>(RTA_DATA(attr));
+                } else if (attr->rta_type == RTA_GATEWAY) {
+                    gateway = formatAddress(info->rtm_family, RTA_DATA(attr));
+                }
+            }
+
+            auto link = links.find(oif);
+            if (link == links.end() || !link->second.up) {
+                return;
+            }
+
+            if (link->second.tunnel) {
+                tunnelDefault = true;
+            }
+
+            if (table != RT_TABLE_MAIN) {
+                return;
+            }
+
+            if (!gateway.empty()) {
+                result.gateways.insert(gateway);
+            }
+
+            if (metric < bestMetric) {
+                bestMetric = metric;
+                bestIndex = oif;
+                result.default_interface = link->second.name;
+            }
+        };
+        dump(fd, RTM_GETROUTE, AF_INET, routes);
+        dump(fd, RTM_GETROUTE, AF_INET6, routes);
+
+        if (auto addresses = addressed.find(bestIndex); addresses != addressed.end()) {
+            result.addresses = addresses->second;
+        }
+
+        for (const auto& [index, link] : links) {
+            if (!link.up || !addressed.contains(index)) {
+                continue;
+            }
+
+            result.connected_networks_count++;
+            if (link.tunnel) {
+                result.vpn_detected = true;
+            }
+        }
+
+        result.vpn_detected = result.vpn_detected || tunnelDefault;
+
+        return result;
+    }
+
+    // Read everything queued on the event socket, return true if any of it was relevant
+    bool drainEvents(int fd) {
+        alignas(nlmsghdr) std::array<char, 16384> buffer;
+        bool relevant = false;
+
+        while (true) {
+            ssize_t length = recv(fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+            if (length < 0) {
+                // ENOBUFS means events were dropped, treat as a change
+                return relevant || errno == ENOBUFS;
+            }
+
+            for (auto* message = reinterpret_cast<nlmsghdr*>(buffer.data());
+                 NLMSG_OK(message, static_cast<unsigned int>(length));
+                 message = NLMSG_NEXT(message, length)) {
+                switch (message->nlmsg_type) {
+                    case RTM_NEWLINK:
+                    case RTM_DELLINK:
+                    case RTM_NEWADDR:
+                    case RTM_DELADDR:
+                    case RTM_NEWROUTE:
+                    case RTM_DELROUTE:
+                        relevant = true;
+                        break;
+                }
+            }
+        }
+    }
+}
+
+NetworkInformation queryNetwork() {
+    int fd = openSocket(0);
+    if (fd < 0) {
+        return {};
+    }
+
+    auto result = query(fd);
+    close(fd);
+    return result;
+}
+
+bool startMonitor(ChangeCallback callback) {
+    std::lock_guard lock(monitorMutex);
+
+    if (monitorFuture.valid()) {
+        return true;
+    }
+
+    int eventsFd = openSocket(MONITOR_GROUPS);
+    int queryFd = openSocket(0);
+    stopFd = eventfd(0, EFD_CLOEXEC);
+
+    if (eventsFd < 0 || queryFd < 0 || stopFd < 0) {
+        if (eventsFd >= 0) close(eventsFd);
+        if (queryFd >= 0) close(queryFd);
+        if (stopFd >= 0) close(stopFd);
+        stopFd = -1;
+        return false;
+    }
+
+    monitorFuture = std::async(std::launch::async, [eventsFd, queryFd, callback = std::move(callback)] {
+        auto current = query(queryFd);
+        callback(current);
+
+        std::array<pollfd, 2> fds {{
+            { eventsFd, POLLIN, 0 },
+            { stopFd, POLLIN, 0 },
+        }};
+
+        while (true) {
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+
+            if (fds[1].revents & POLLIN) {
+                break;
+            }
+
+            // A single change (eg. wifi reconnect) produces a burst of messages
+            // Drain them all and query once
+            if (!drainEvents(eventsFd)) {
+                continue;
+            }
+
+            auto updated = query(queryFd);
+            if (updated != current) {
+                current = updated;
+                callback(current);
+            }
+        }
+
+        close(eventsFd);
+        close(queryFd);
+    });
+
+    return true;
+}
+
+void stopMonitor() {
+    std::lock_guard lock(monitorMutex);
+
+    if (!monitorFuture.valid()) {
+        return;
+    }
+
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t written = write(stopFd, &one, sizeof(one));
+    monitorFuture.get();
+
+    close(stopFd);
+    stopFd = -1;
+}
+
+} // namespace platform::network
+
+#endif // DROPSHIP_LINUX
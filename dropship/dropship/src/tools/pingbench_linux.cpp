@@ -0,0 +1,258 @@
+// Load test for the ping engine, run inside linux/ping-rig.sh
+// Pings consecutive addresses from a base address and reports what each probe cost and how far off its rtt was
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "util/ping/PingService.h"
+
+namespace {
+
+struct Options {
+    std::string base = "198.18.0.1";
+    size_t targets = 1000;
+    util::ping::Method method = util::ping::Method::icmp;
+    int seconds = 30;
+
+    // The adds each start a tick, let that settle before measuring
+    int warmup = 2;
+    size_t threads = 1;
+
+    // The rtt the rig was set up with. Errors are only reported when it's known
+    std::optional<double> expect_ms;
+};
+
+void usage() {
+    std::cerr << "usage: dropship-pingbench [--base ADDRESS] [--targets N] [--method icmp|unreachable|udp|tcp]\n"
+                 "                          [--seconds S] [--warmup S] [--threads T] [--expect-ms RTT]\n";
+}
+
+std::optional<Options> parseOptions(int argc, char** argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return std::nullopt;
+        }
+        const std::string value = argv[++i];
+
+        if (arg == "--base") {
+            options.base = value;
+        } else if (arg == "--targets") {
+            options.targets = std::stoul(value);
+        } else if (arg == "--seconds") {
+            options.seconds = std::stoi(value);
+        } else if (arg == "--warmup") {
+            options.warmup = std::stoi(value);
+        } else if (arg == "--threads") {
+            options.threads = std::stoul(value);
+        } else if (arg == "--expect-ms") {
+            options.expect_ms = std::stod(value);
+        } else if (arg == "--method") {
+            if (value == "icmp") options.method = util::ping::Method::icmp;
+            else if (value == "unreachable") options.method = util::ping::Method::unreachable;
+            else if (value == "udp") options.method = util::ping::Method::udp;
+            else if (value == "tcp") options.method = util::ping::Method::tcp;
+            else return std::nullopt;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    return options;
+}
+
+// Counts every syscall of this process and the threads it starts from now on
+// Needs the raw_syscalls tracepoint (tracefs) and root or kernel.perf_event_paranoid <= 1
+class SyscallCounter {
+public:
+    SyscallCounter() {
+        std::ifstream id_file("/sys/kernel/tracing/events/raw_syscalls/sys_enter/id");
+        if (!id_file) {
+            id_file.open("/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id");
+        }
+
+        uint64_t id = 0;
+        if (!(id_file >> id)) {
+            return;
+        }
+
+        perf_event_attr attr {};
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.size = sizeof(attr);
+        attr.config = id;
+        attr.inherit = 1;
+        attr.exclude_hv = 1;
+
+        this->fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~SyscallCounter() {
+        if (this->fd >= 0) {
+            close(this->fd);
+        }
+    }
+
+    // Includes the threads still running
+    std::optional<uint64_t> read() const {
+        uint64_t count = 0;
+        if (this->fd < 0 || ::read(this->fd, &count, sizeof(count)) != sizeof(count)) {
+            return std::nullopt;
+        }
+        return count;
+    }
+
+private:
+    int fd = -1;
+};
+
+double cpuSeconds() {
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+float percentile(std::vector<float> values, float p) {
+    if (values.empty()) {
+        return 0.0f;
+    }
+    const size_t rank = std::min(values.size() - 1, static_cast<size_t>(std::ceil(p * values.size())) - 1);
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+
+}
+
+int main(int argc, char** argv) {
+    const auto options = parseOptions(argc, argv);
+    if (!options) {
+        usage();
+        return 2;
+    }
+
+    asio::error_code error;
+    const auto base = asio::ip::make_address(options->base, error);
+    if (error) {
+        std::cerr << "Not an address: " << options->base << "\n";
+        return 2;
+    }
+
+    // Before the service starts its threads, so they're counted
+    SyscallCounter syscalls;
+
+    util::ping::PingService ping_service(options->threads);
+    std::vector<util::ping::TargetId> targets;
+
+    for (size_t i = 0; i < options->targets; i++) {
+        std::string address;
+        if (base.is_v4()) {
+            address = asio::ip::address_v4(base.to_v4().to_uint() + static_cast<uint32_t>(i)).to_string();
+        } else {
+            auto bytes = base.to_v6().to_bytes();
+            const uint32_t low = (uint32_t(bytes[12]) << 24 | uint32_t(bytes[13]) << 16 | uint32_t(bytes[14]) << 8 | bytes[15]) + static_cast<uint32_t>(i);
+            bytes[12] = static_cast<uint8_t>(low >> 24);
+            bytes[13] = static_cast<uint8_t>(low >> 16);
+            bytes[14] = static_cast<uint8_t>(low >> 8);
+            bytes[15] = static_cast<uint8_t>(low);
+            address = asio::ip::address_v6(bytes).to_string();
+        }
+
+        try {
+            targets.push_back(ping_service.add(address, { .method = options->method }));
+        } catch (const std::exception& e) {
+            std::cerr << "Stopped at " << targets.size() << " targets: " << e.what() << "\n";
+            break;
+        }
+    }
+
+    if (targets.empty()) {
+        return 1;
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(options->warmup));
+
+    const auto cpu_before = cpuSeconds();
+    const auto syscalls_before = syscalls.read();
+    const auto counters_before = ping_service.getCounters();
+
+    std::this_thread::sleep_for(std::chrono::seconds(options->seconds));
+
+    const auto cpu_after = cpuSeconds();
+    const auto syscalls_after = syscalls.read();
+    const auto counters_after = ping_service.getCounters();
+
+    const uint64_t probes = counters_after.probes - counters_before.probes;
+    const uint64_t replies = counters_after.replies - counters_before.replies;
+
+    std::vector<float> p50s;
+    std::vector<float> errors;
+    size_t answering = 0;
+    size_t kernel_timed = 0;
+
+    for (auto target : targets) {
+        const auto statistics = ping_service.getStatistics(target);
+        if (!statistics || !statistics->valid()) {
+            continue;
+        }
+
+        answering++;
+        p50s.push_back(statistics->p50);
+
+        if (statistics->error) {
+            kernel_timed++;
+            errors.push_back(statistics->error.value());
+        }
+    }
+
+    std::printf("targets      %zu, %zu answering, %zu kernel timed\n", targets.size(), answering, kernel_timed);
+    std::printf("probes       %llu in %d s, %.1f%% unanswered\n", static_cast<unsigned long long>(probes), options->seconds,
+                probes ? 100.0 * (probes - std::min(replies, probes)) / probes : 0.0);
+
+    if (probes == 0) {
+        return 1;
+    }
+
+    std::printf("cpu          %.2f us per probe\n", (cpu_after - cpu_before) * 1e6 / probes);
+
+    if (syscalls_before && syscalls_after) {
+        std::printf("syscalls     %.3f per probe\n", static_cast<double>(syscalls_after.value() - syscalls_before.value()) / probes);
+    } else {
+        std::printf("syscalls     not counted, needs root and tracefs\n");
+    }
+
+    if (!p50s.empty()) {
+        std::printf("rtt p50      median %.3f ms, p95 of targets %.3f ms\n", percentile(p50s, 0.5f), percentile(p50s, 0.95f));
+    }
+
+    if (options->expect_ms && !p50s.empty()) {
+        std::vector<float> offsets;
+        for (auto p50 : p50s) {
+            offsets.push_back(std::fabs(p50 - static_cast<float>(options->expect_ms.value())));
+        }
+        std::printf("rtt error    against %.3f ms: median %.3f ms, p95 %.3f ms\n", options->expect_ms.value(),
+                    percentile(offsets, 0.5f), percentile(offsets, 0.95f));
+    }
+
+    if (!errors.empty()) {
+        std::printf("clock bound  median %.4f ms, worst %.4f ms\n", percentile(errors, 0.5f), percentile(errors, 1.0f));
+    }
+
+    return 0;
+}
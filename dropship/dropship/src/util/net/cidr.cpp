@@ -0,0 +1,262 @@
+#include "cidr.h"
+
+#if defined(_WIN32)
+#include <ws2tcpip.h> // inet_pton, inet_ntop
+#else
+#include <arpa/inet.h>
+#endif
+
+#include <algorithm>
+#include <charconv>
+
+namespace util::net {
+
+	namespace {
+		constexpr std::array<uint8_t, 12> v4_mapped { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+		/* offset of the family's first bit in the 128 bit mapped space */
+		int familyOffset(const Address& a) { return a.v4() ? 96 : 0; }
+
+		Address masked(const Address& a, int length)
+		{
+			Address result = a;
+			for (int i = 0; i < 16; i++)
+			{
+				const int bits = std::clamp(length - (i * 8), 0, 8);
+				result.bytes[i] &= static_cast<uint8_t>(0xff00 >> bits);
+			}
+			return result;
+		}
+	}
+
+	bool Address::v4() const
+	{
+		return std::equal(v4_mapped.begin(), v4_mapped.end(), this->bytes.begin());
+	}
+
+	Address Address::fromV4(uint32_t address)
+	{
+		Address result;
+		std::copy(v4_mapped.begin(), v4_mapped.end(), result.bytes.begin());
+		result.bytes[12] = static_cast<uint8_t>(address >> 24);
+		result.bytes[13] = static_cast<uint8_t>(address >> 16);
+		result.bytes[14] = static_cast<uint8_t>(address >> 8);
+		result.bytes[15] = static_cast<uint8_t>(address);
+		return result;
+	}
+
+	Address Address::fromV6(const uint8_t* bytes)
+	{
+		Address result;
+		std::copy(bytes, bytes + 16, result.bytes.begin());
+		return result;
+	}
+
+	std::optional<Address> Address::parse(std::string_view text)
+	{
+		/* inet_pton wants a terminated string */
+		char buffer[INET6_ADDRSTRLEN] {};
+		if (text.empty() || text.size() >= sizeof(buffer)) return std::nullopt;
+		std::copy(text.begin(), text.end(), buffer);
+
+		if (text.find(':') == std::string_view::npos)
+		{
+			uint8_t v4[4];
+			if (inet_pton(AF_INET, buffer, v4) != 1) return std::nullopt;
+			return fromV4((uint32_t(v4[0]) << 24) | (uint32_t(v4[1]) << 16) | (uint32_t(v4[2]) << 8) | v4[3]);
+		}
+
+		uint8_t v6[16];
+		if (inet_pton(AF_INET6, buffer, v6) != 1) return std::nullopt;
+		return fromV6(v6);
+	}
+
+	std::string Address::toString() const
+	{
+		char buffer[INET6_ADDRSTRLEN] {};
+
+		if (this->v4())
+		{
+			inet_ntop(AF_INET, this->bytes.data() + 12, buffer, sizeof(buffer));
+		}
+		else
+		{
+			inet_ntop(AF_INET6, this->bytes.data(), buffer, sizeof(buffer));
+		}
+
+		return buffer;
+	}
+
+	int Prefix::familyLength() const
+	{
+		return this->length - familyOffset(this->address);
+	}
+
+	bool Prefix::contains(const Address& a) const
+	{
+		return masked(a, this->length) == this->address;
+	}
+
+	Prefix Prefix::truncated(int family_length) const
+	{
+		return of(this->address, std::min(family_length, this->familyLength()));
+	}
+
+	Prefix Prefix::sibling() const
+	{
+		Prefix result = *this;
+		if (this->familyLength() == 0) return result;
+
+		const int bit = this->length - 1;
+		result.address.bytes[bit / 8] ^= static_cast<uint8_t>(0x80 >> (bit % 8));
+		return result;
+	}
+
+	Prefix Prefix::of(const Address& a, int family_length)
+	{
+		const int length = familyOffset(a) + family_length;
+		return { masked(a, length), length };
+	}
+
+	std::optional<Prefix> Prefix::parse(std::string_view cidr)
+	{
+		const auto slash = cidr.find('/');
+
+		auto address = Address::parse(cidr.substr(0, slash));
+		if (!address) return std::nullopt;
+
+		const int max_length = address.value().v4() ? 32 : 128;
+		int family_length = max_length;
+
+		if (slash != std::string_view::npos)
+		{
+			auto digits = cidr.substr(slash + 1);
+			auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), family_length);
+			if (error != std::errc() || end != digits.data() + digits.size()) return std::nullopt;
+			if (family_length < 0 || family_length > max_length) return std::nullopt;
+		}
+
+		return of(address.value(), family_length);
+	}
+
+	std::string Prefix::toString() const
+	{
+		return this->address.toString() + "/" + std::to_string(this->familyLength());
+	}
+
+	std::vector<Prefix> parsePrefixes(std::string_view cidrs)
+	{
+		std::vector<Prefix> result;
+
+		size_t start = 0;
+		while (start < cidrs.size())
+		{
+			auto end = cidrs.find(',', start);
+			if (end == std::string_view::npos) end = cidrs.size();
+
+			if (auto prefix = Prefix::parse(cidrs.substr(start, end - start)))
+			{
+				result.push_back(prefix.value());
+			}
+
+			start = end + 1;
+		}
+
+		return result;
+	}
+
+	Classifier::Key Classifier::Key::of(const Address& a)
+	{
+		Key result;
+		for (int i = 0; i < 8; i++)
+		{
+			result.high = (result.high << 8) | a.bytes[i];
+			result.low = (result.low << 8) | a.bytes[i + 8];
+		}
+		return result;
+	}
+
+	void Classifier::add(const std::string& label, std::string_view cidrs)
+	{
+		this->_labels.push_back(label);
+
+		for (auto& prefix : parsePrefixes(cidrs))
+		{
+			this->_prefixes.push_back({ prefix, this->_labels.size() - 1 });
+		}
+
+		this->_flatten();
+	}
+
+	void Classifier::_flatten()
+	{
+		/* every prefix start and one past every prefix end is a boundary */
+		std::vector<Key> boundaries { Key {} };
+
+		for (auto& [prefix, label] : this->_prefixes)
+		{
+			boundaries.push_back(Key::of(prefix.address));
+
+			/* last address of the prefix */
+			Address last = prefix.address;
+			for (int bit = prefix.length; bit < 128; bit++)
+			{
+				last.bytes[bit / 8] |= static_cast<uint8_t>(0x80 >> (bit % 8));
+			}
+
+			Key next = Key::of(last);
+			if (++next.low == 0 && ++next.high == 0) continue; /* ran off the end of the space */
+			boundaries.push_back(next);
+		}
+
+		std::sort(boundaries.begin(), boundaries.end());
+		boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+		this->_range_starts.clear();
+		this->_range_labels.clear();
+
+		/* nothing in a range crosses a boundary, so its start decides the whole range */
+		for (auto& start : boundaries)
+		{
+			Address a;
+			for (int i = 0; i < 8; i++)
+			{
+				a.bytes[i] = static_cast<uint8_t>(start.high >> (56 - i * 8));
+				a.bytes[i + 8] = static_cast<uint8_t>(start.low >> (56 - i * 8));
+			}
+
+			size_t label = __no_label;
+			int best_length = -1;
+			for (auto& [prefix, prefix_label] : this->_prefixes)
+			{
+				if (prefix.length > best_length && prefix.contains(a))
+				{
+					label = prefix_label;
+					best_length = prefix.length;
+				}
+			}
+
+			/* join neighbours with the same label */
+			if (!this->_range_labels.empty() && this->_range_labels.back() == label) continue;
+
+			this->_range_starts.push_back(start);
+			this->_range_labels.push_back(label);
+		}
+	}
+
+	int Classifier::classifyIndex(const Address& a) const
+	{
+		if (this->_range_starts.empty()) return -1;
+
+		const auto it = std::upper_bound(this->_range_starts.begin(), this->_range_starts.end(), Key::of(a));
+		const auto label = this->_range_labels[(it - this->_range_starts.begin()) - 1];
+
+		return label == __no_label ? -1 : static_cast<int>(label);
+	}
+
+	const std::string* Classifier::classify(const Address& a) const
+	{
+		const int index = this->classifyIndex(a);
+		return index < 0 ? nullptr : &(this->_labels[index]);
+	}
+}
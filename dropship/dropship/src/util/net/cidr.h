@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <compare>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* no pch, shared by the windows and linux builds */
+
+namespace util::net {
+
+	/* ipv4 is stored v4-mapped (::ffff:a.b.c.d) so both families share one type */
+	struct Address
+	{
+		std::array<uint8_t, 16> bytes {};
+
+		bool v4() const;
+
+		/* ipv4 in host byte order */
+		static Address fromV4(uint32_t address);
+		static Address fromV6(const uint8_t* bytes);
+		static std::optional<Address> parse(std::string_view text);
+
+		std::string toString() const;
+
+		auto operator<=>(const Address&) const = default;
+	};
+
+	struct Prefix
+	{
+		/* masked to length */
+		Address address;
+
+		/* in the 128 bit mapped space, an ipv4 /24 is 120 */
+		int length { 0 };
+
+		/* length in bits of the address's own family */
+		int familyLength() const;
+
+		bool contains(const Address& a) const;
+
+		/* shorten to family_length bits of the address's own family */
+		Prefix truncated(int family_length) const;
+
+		/* the other half of this prefix's parent */
+		Prefix sibling() const;
+
+		static Prefix of(const Address& a, int family_length);
+		static std::optional<Prefix> parse(std::string_view cidr);
+
+		std::string toString() const;
+
+		auto operator<=>(const Prefix&) const = default;
+	};
+
+	/* comma separated, as in dropship::settings::unique_server::block. invalid entries are skipped */
+	std::vector<Prefix> parsePrefixes(std::string_view cidrs);
+
+	/*
+		longest prefix match from address to label
+		prefixes are flattened into sorted, disjoint ranges so a lookup is one binary search
+	*/
+	class Classifier
+	{
+		/* consts */
+		private:
+			static constexpr size_t __no_label { SIZE_MAX };
+
+		public:
+			void add(const std::string& label, std::string_view cidrs);
+
+			/* nullptr if no prefix matches */
+			const std::string* classify(const Address& a) const;
+
+			const std::vector<std::string>& getLabels() const { return this->_labels; }
+
+			/* index into getLabels(), or -1 if no prefix matches */
+			int classifyIndex(const Address& a) const;
+
+		private:
+			/* address as two big endian halves, compares the same as the bytes */
+			struct Key
+			{
+				uint64_t high { 0 };
+				uint64_t low { 0 };
+
+				static Key of(const Address& a);
+
+				auto operator<=>(const Key&) const = default;
+			};
+
+			/* rebuild _ranges from _prefixes */
+			void _flatten();
+
+			std::vector<std::string> _labels;
+			std::vector<std::pair<Prefix, size_t>> _prefixes;
+
+			/* range starts, each runs up to the next start. first always starts at 0 */
+			std::vector<Key> _range_starts;
+			std::vector<size_t> _range_labels;
+	};
+}
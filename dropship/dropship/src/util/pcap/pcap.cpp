@@ -0,0 +1,798 @@
+#include "pcap.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace util::pcap {
+
+	namespace {
+		/* classic pcap magic, as read in our byte order */
+		constexpr uint32_t PCAP_MICROSECONDS { 0xa1b2c3d4 };
+		constexpr uint32_t PCAP_NANOSECONDS { 0xa1b23c4d };
+
+		/* pcapng */
+		constexpr uint32_t BLOCK_SECTION_HEADER { 0x0a0d0d0a };
+		constexpr uint32_t BLOCK_INTERFACE_DESCRIPTION { 0x00000001 };
+		constexpr uint32_t BLOCK_PACKET { 0x00000002 }; /* obsolete, still written by old tools */
+		constexpr uint32_t BLOCK_SIMPLE_PACKET { 0x00000003 };
+		constexpr uint32_t BLOCK_ENHANCED_PACKET { 0x00000006 };
+		constexpr uint32_t BYTE_ORDER_MAGIC { 0x1a2b3c4d };
+		constexpr uint16_t OPTION_END { 0 };
+		constexpr uint16_t OPTION_IF_TSRESOL { 9 };
+		constexpr uint16_t OPTION_EPB_FLAGS { 2 };
+
+		/* local use, every reader skips it. fills the unwritten rest of a segment */
+		constexpr uint32_t BLOCK_PADDING { 0x80000000 };
+
+		/* link types */
+		constexpr uint32_t LINKTYPE_NULL { 0 };
+		constexpr uint32_t LINKTYPE_ETHERNET { 1 };
+		constexpr uint32_t LINKTYPE_RAW { 101 };
+		constexpr uint32_t LINKTYPE_LOOP { 108 };
+		constexpr uint32_t LINKTYPE_LINUX_SLL { 113 };
+		constexpr uint32_t LINKTYPE_IPV4 { 228 };
+		constexpr uint32_t LINKTYPE_IPV6 { 229 };
+		constexpr uint32_t LINKTYPE_LINUX_SLL2 { 276 };
+
+		/* DLT_RAW on some bsds */
+		constexpr uint32_t DLT_RAW_BSD { 12 };
+		constexpr uint32_t DLT_RAW_OPENBSD { 14 };
+
+		constexpr uint16_t ETHERTYPE_IPV4 { 0x0800 };
+		constexpr uint16_t ETHERTYPE_IPV6 { 0x86dd };
+		constexpr uint16_t ETHERTYPE_VLAN { 0x8100 };
+		constexpr uint16_t ETHERTYPE_QINQ { 0x88a8 };
+
+		constexpr uint8_t PROTOCOL_TCP { 6 };
+		constexpr uint8_t PROTOCOL_UDP { 17 };
+
+		uint16_t be16(const uint8_t* p) { return static_cast<uint16_t>((p[0] << 8) | p[1]); }
+
+		uint32_t swap32(uint32_t v)
+		{
+			return ((v & 0xff) << 24) | ((v & 0xff00) << 8) | ((v >> 8) & 0xff00) | (v >> 24);
+		}
+
+		int64_t toNanoseconds(uint64_t ticks, uint64_t resolution)
+		{
+			constexpr uint64_t NS { 1'000'000'000 };
+
+			if (resolution == NS) return static_cast<int64_t>(ticks);
+			if (resolution < NS && NS % resolution == 0) return static_cast<int64_t>(ticks * (NS / resolution));
+
+			return static_cast<int64_t>((ticks / resolution) * NS + ((ticks % resolution) * NS) / resolution);
+		}
+
+		/* ip header onward */
+		std::optional<Datagram> decodeIp(const uint8_t* p, size_t length)
+		{
+			if (length < 1) return std::nullopt;
+
+			Datagram d;
+			const uint8_t* transport = nullptr;
+			size_t transport_length = 0;
+
+			switch (p[0] >> 4)
+			{
+				case 4:
+				{
+					const size_t header_length = (p[0] & 0x0f) * 4u;
+					if (length < 20 || header_length < 20 || length < header_length) return std::nullopt;
+
+					d.protocol = p[9];
+					d.length = be16(p + 2);
+					d.source = util::net::Address::fromV4((uint32_t(p[12]) << 24) | (uint32_t(p[13]) << 16) | (uint32_t(p[14]) << 8) | p[15]);
+					d.destination = util::net::Address::fromV4((uint32_t(p[16]) << 24) | (uint32_t(p[17]) << 16) | (uint32_t(p[18]) << 8) | p[19]);
+
+					/* later fragments don't carry the ports */
+					if ((be16(p + 6) & 0x1fff) == 0)
+					{
+						transport = p + header_length;
+						transport_length = length - header_length;
+					}
+					break;
+				}
+				case 6:
+				{
+					if (length < 40) return std::nullopt;
+
+					d.length = 40u + be16(p + 4);
+					d.source = util::net::Address::fromV6(p + 8);
+					d.destination = util::net::Address::fromV6(p + 24);
+
+					/* walk the extension headers to the transport */
+					uint8_t next = p[6];
+					size_t offset = 40;
+					bool first_fragment = true;
+
+					while (offset + 8 <= length)
+					{
+						if (next == 0 || next == 43 || next == 60) /* hop-by-hop, routing, destination */
+						{
+							const size_t size = (p[offset + 1] + 1u) * 8u;
+							next = p[offset];
+							offset += size;
+						}
+						else if (next == 44) /* fragment */
+						{
+							first_fragment = (be16(p + offset + 2) & 0xfff8) == 0;
+							next = p[offset];
+							offset += 8;
+						}
+						else if (next == 51) /* authentication */
+						{
+							const size_t size = (p[offset + 1] + 2u) * 4u;
+							next = p[offset];
+							offset += size;
+						}
+						else break;
+					}
+
+					d.protocol = next;
+
+					if (first_fragment && offset <= length)
+					{
+						transport = p + offset;
+						transport_length = length - offset;
+					}
+					break;
+				}
+				default:
+					return std::nullopt;
+			}
+
+			if (transport && transport_length >= 4 && (d.protocol == PROTOCOL_TCP || d.protocol == PROTOCOL_UDP))
+			{
+				d.source_port = be16(transport);
+				d.destination_port = be16(transport + 2);
+			}
+
+			return d;
+		}
+
+		std::optional<Datagram> decodeEthertype(uint16_t type, const uint8_t* p, size_t length)
+		{
+			if (type == ETHERTYPE_IPV4 || type == ETHERTYPE_IPV6) return decodeIp(p, length);
+			return std::nullopt;
+		}
+	}
+
+	std::optional<Datagram> decode(const Packet& packet)
+	{
+		const uint8_t* p = packet.data;
+		const size_t length = packet.captured_length;
+
+		switch (packet.link_type)
+		{
+			case LINKTYPE_ETHERNET:
+			{
+				size_t offset = 12;
+				if (length < offset + 2) return std::nullopt;
+
+				uint16_t type = be16(p + offset);
+				while ((type == ETHERTYPE_VLAN || type == ETHERTYPE_QINQ) && length >= offset + 6)
+				{
+					offset += 4;
+					type = be16(p + offset);
+				}
+
+				return decodeEthertype(type, p + offset + 2, length - offset - 2);
+			}
+			case LINKTYPE_RAW:
+			case DLT_RAW_BSD:
+			case DLT_RAW_OPENBSD:
+			case LINKTYPE_IPV4:
+			case LINKTYPE_IPV6:
+				return decodeIp(p, length);
+			case LINKTYPE_LINUX_SLL:
+				if (length < 16) return std::nullopt;
+				return decodeEthertype(be16(p + 14), p + 16, length - 16);
+			case LINKTYPE_LINUX_SLL2:
+				if (length < 20) return std::nullopt;
+				return decodeEthertype(be16(p), p + 20, length - 20);
+			case LINKTYPE_NULL:
+			case LINKTYPE_LOOP:
+				/* address family, in either byte order. the version nibble tells us which ip anyway */
+				if (length < 4) return std::nullopt;
+				return decodeIp(p + 4, length - 4);
+			default:
+				return std::nullopt;
+		}
+	}
+
+
+	Reader::Reader(const std::filesystem::path& path)
+	{
+#if defined(_WIN32)
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("can't open " + path.string());
+		this->_file = file;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		{
+			this->_unmap();
+			throw std::runtime_error("empty capture " + path.string());
+		}
+		this->_size = static_cast<size_t>(size.QuadPart);
+
+		this->_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (this->_mapping) this->_data = static_cast<const uint8_t*>(MapViewOfFile(this->_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!this->_data)
+		{
+			this->_unmap();
+			throw std::runtime_error("can't map " + path.string());
+		}
+#else
+		const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) throw std::runtime_error("can't open " + path.string());
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			close(fd);
+			throw std::runtime_error("empty capture " + path.string());
+		}
+		this->_size = static_cast<size_t>(st.st_size);
+
+		void* data = mmap(nullptr, this->_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED) throw std::runtime_error("can't map " + path.string());
+
+		/* read ahead aggressively and drop pages behind us */
+		madvise(data, this->_size, MADV_SEQUENTIAL);
+		this->_data = static_cast<const uint8_t*>(data);
+#endif
+
+		if (this->_size < 24)
+		{
+			this->_unmap();
+			throw std::runtime_error("not a capture " + path.string());
+		}
+
+		uint32_t magic;
+		std::memcpy(&magic, this->_data, 4);
+
+		if (magic == BLOCK_SECTION_HEADER)
+		{
+			this->_pcapng = true;
+			if (this->_readSectionHeader()) return;
+		}
+		else if (magic == PCAP_MICROSECONDS || magic == PCAP_NANOSECONDS || swap32(magic) == PCAP_MICROSECONDS || swap32(magic) == PCAP_NANOSECONDS)
+		{
+			this->_swapped = swap32(magic) == PCAP_MICROSECONDS || swap32(magic) == PCAP_NANOSECONDS;
+			this->_nanosecond = magic == PCAP_NANOSECONDS || swap32(magic) == PCAP_NANOSECONDS;
+
+			/* upper bits may hold fcs info */
+			this->_link_type = this->_read32(20) & 0x0fffffff;
+			this->_offset = 24;
+			return;
+		}
+
+		this->_unmap();
+		throw std::runtime_error("not a capture " + path.string());
+	}
+
+	Reader::~Reader()
+	{
+		this->_unmap();
+	}
+
+	void Reader::_unmap()
+	{
+#if defined(_WIN32)
+		if (this->_data) UnmapViewOfFile(this->_data);
+		if (this->_mapping) CloseHandle(this->_mapping);
+		if (this->_file) CloseHandle(this->_file);
+		this->_file = nullptr;
+		this->_mapping = nullptr;
+#else
+		if (this->_data) munmap(const_cast<uint8_t*>(this->_data), this->_size);
+#endif
+		this->_data = nullptr;
+	}
+
+	uint16_t Reader::_read16(size_t offset) const
+	{
+		uint16_t v;
+		std::memcpy(&v, this->_data + offset, 2);
+		return this->_swapped ? static_cast<uint16_t>((v >> 8) | (v << 8)) : v;
+	}
+
+	uint32_t Reader::_read32(size_t offset) const
+	{
+		uint32_t v;
+		std::memcpy(&v, this->_data + offset, 4);
+		return this->_swapped ? swap32(v) : v;
+	}
+
+	bool Reader::next(Packet& packet)
+	{
+		return this->_pcapng ? this->_nextPcapng(packet) : this->_nextPcap(packet);
+	}
+
+	bool Reader::_nextPcap(Packet& packet)
+	{
+		if (this->_offset + 16 > this->_size) return false;
+
+		const uint32_t seconds = this->_read32(this->_offset);
+		const uint32_t fraction = this->_read32(this->_offset + 4);
+		const uint32_t captured = this->_read32(this->_offset + 8);
+
+		if (captured > this->_size - this->_offset - 16) return false;
+
+		packet.timestamp_ns = int64_t(seconds) * 1'000'000'000 + (this->_nanosecond ? fraction : int64_t(fraction) * 1'000);
+		packet.link_type = this->_link_type;
+		packet.data = this->_data + this->_offset + 16;
+		packet.captured_length = captured;
+		packet.original_length = this->_read32(this->_offset + 12);
+
+		this->_offset += 16 + size_t(captured);
+		return true;
+	}
+
+	bool Reader::_readSectionHeader()
+	{
+		if (this->_offset + 28 > this->_size) return false;
+
+		uint32_t magic;
+		std::memcpy(&magic, this->_data + this->_offset + 8, 4);
+
+		if (magic == BYTE_ORDER_MAGIC) this->_swapped = false;
+		else if (swap32(magic) == BYTE_ORDER_MAGIC) this->_swapped = true;
+		else return false;
+
+		this->_interfaces.clear();
+		return true;
+	}
+
+	bool Reader::_nextPcapng(Packet& packet)
+	{
+		while (this->_offset + 12 <= this->_size)
+		{
+			uint32_t type;
+			std::memcpy(&type, this->_data + this->_offset, 4);
+
+			/* the section header is a palindrome, its length needs the byte order it sets */
+			if (type == BLOCK_SECTION_HEADER && !this->_readSectionHeader()) return false;
+
+			type = this->_read32(this->_offset);
+			const size_t block = this->_offset;
+			const uint32_t length = this->_read32(block + 4);
+
+			if (length < 12 || length % 4 != 0 || length > this->_size - block) return false;
+
+			/* block body, without the type, length and trailing length */
+			const size_t body = block + 8;
+			const size_t body_length = length - 12;
+
+			this->_offset += length;
+
+			switch (type)
+			{
+				case BLOCK_INTERFACE_DESCRIPTION:
+				{
+					if (body_length < 8) return false;
+
+					Interface description { this->_read16(body), 1'000'000 };
+
+					/* options, looking for the timestamp resolution */
+					size_t option = body + 8;
+					while (option + 4 <= body + body_length)
+					{
+						const uint16_t code = this->_read16(option);
+						const uint16_t option_length = this->_read16(option + 2);
+						if (code == OPTION_END || option + 4 + option_length > body + body_length) break;
+
+						if (code == OPTION_IF_TSRESOL && option_length >= 1)
+						{
+							const uint8_t resolution = this->_data[option + 4];
+							const uint8_t exponent = resolution & 0x7f;
+
+							description.resolution = 1;
+							for (uint8_t i = 0; i < exponent && description.resolution < (uint64_t(1) << 60); i++)
+							{
+								description.resolution *= (resolution & 0x80) ? 2 : 10;
+							}
+						}
+
+						option += 4 + ((option_length + 3u) & ~3u);
+					}
+
+					this->_interfaces.push_back(description);
+					break;
+				}
+				case BLOCK_ENHANCED_PACKET:
+				case BLOCK_PACKET:
+				{
+					if (body_length < 20) return false;
+
+					const uint32_t id = type == BLOCK_PACKET ? this->_read16(body) : this->_read32(body);
+					if (id >= this->_interfaces.size()) return false;
+
+					const uint32_t captured = this->_read32(body + 12);
+					if (captured > body_length - 20) return false;
+
+					const uint64_t ticks = (uint64_t(this->_read32(body + 4)) << 32) | this->_read32(body + 8);
+
+					packet.timestamp_ns = toNanoseconds(ticks, this->_interfaces[id].resolution);
+					packet.link_type = this->_interfaces[id].link_type;
+					packet.data = this->_data + body + 20;
+					packet.captured_length = captured;
+					packet.original_length = this->_read32(body + 16);
+					return true;
+				}
+				case BLOCK_SIMPLE_PACKET:
+				{
+					if (body_length < 4 || this->_interfaces.empty()) return false;
+
+					packet.timestamp_ns = 0;
+					packet.link_type = this->_interfaces[0].link_type;
+					packet.data = this->_data + body + 4;
+					packet.original_length = this->_read32(body);
+					packet.captured_length = (std::min)(packet.original_length, static_cast<uint32_t>(body_length - 4));
+					return true;
+				}
+				default:
+					/* section headers, statistics, name resolution, ... */
+					break;
+			}
+		}
+
+		return false;
+	}
+
+	namespace {
+		void append32(std::vector<uint8_t>& out, uint32_t value)
+		{
+			const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+			out.insert(out.end(), bytes, bytes + 4);
+		}
+
+		void append16(std::vector<uint8_t>& out, uint16_t value)
+		{
+			const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+			out.insert(out.end(), bytes, bytes + 2);
+		}
+
+		/* section header and one interface, with nanosecond timestamps */
+		constexpr uint32_t SEGMENT_HEADER_SIZE { 28 + 32 };
+
+		/* a padding block is at least its type and the two lengths */
+		constexpr uint32_t PADDING_SIZE { 12 };
+	}
+
+	SegmentWriter::SegmentWriter(const std::filesystem::path& directory, uint32_t segments, uint32_t segment_size, uint32_t link_type, uint32_t snap_length)
+		: _segment_size(segment_size & ~3u), _link_type(link_type), _snap_length(snap_length)
+	{
+		if (segments == 0 || this->_segment_size < SEGMENT_HEADER_SIZE + PADDING_SIZE + 64) throw std::runtime_error("segments too small");
+
+		std::error_code ec;
+		std::filesystem::create_directories(directory, ec);
+
+		/* a new segment goes first, then the one written longest ago. what the last run recorded stays the longest */
+		std::filesystem::file_time_type oldest = std::filesystem::file_time_type::max();
+		bool have_fresh = false;
+		uint32_t start = 0;
+
+		for (uint32_t i = 0; i < segments; i++)
+		{
+			const auto path = directory / ("segment-" + std::to_string(i) + ".pcapng");
+			this->_paths.push_back(path);
+			this->_first_ns.push_back(0);
+			this->_packets.push_back(0);
+
+			bool fresh = false;
+
+#if defined(_WIN32)
+			/* no sharing for writes, a second instance gets nothing */
+			HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				this->_close();
+				throw std::runtime_error("can't open " + path.string());
+			}
+			this->_files.push_back(file);
+
+			LARGE_INTEGER current;
+			if (!GetFileSizeEx(file, &current) || current.QuadPart != static_cast<LONGLONG>(this->_segment_size))
+			{
+				LARGE_INTEGER wanted;
+				wanted.QuadPart = this->_segment_size;
+				if (!SetFilePointerEx(file, wanted, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+				{
+					this->_close();
+					throw std::runtime_error("can't size " + path.string());
+				}
+				fresh = true;
+			}
+#else
+			const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+			if (fd < 0)
+			{
+				this->_close();
+				throw std::runtime_error("can't open " + path.string());
+			}
+			this->_fds.push_back(fd);
+
+			/* released when the fd closes, even on a crash */
+			if (i == 0 && flock(fd, LOCK_EX | LOCK_NB) != 0)
+			{
+				this->_close();
+				throw std::runtime_error("in use " + directory.string());
+			}
+
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size != this->_segment_size)
+			{
+				if (ftruncate(fd, 0) != 0 || ftruncate(fd, this->_segment_size) != 0)
+				{
+					this->_close();
+					throw std::runtime_error("can't size " + path.string());
+				}
+				fresh = true;
+			}
+
+			/* real blocks now, so a full disk is found here and not in the middle of a match */
+			if (posix_fallocate(fd, 0, this->_segment_size) != 0)
+			{
+				this->_close();
+				throw std::runtime_error("can't allocate " + path.string());
+			}
+#endif
+
+			if (fresh)
+			{
+				/* an empty capture until it's used */
+				this->_segment = i;
+				this->_startSegment();
+				if (!this->_write())
+				{
+					this->_close();
+					throw std::runtime_error("can't write " + path.string());
+				}
+				this->_batch.clear();
+			}
+
+			const auto time = std::filesystem::last_write_time(path, ec);
+			if (fresh && !have_fresh)
+			{
+				have_fresh = true;
+				start = i;
+			}
+			else if (!have_fresh && !ec && time < oldest)
+			{
+				oldest = time;
+				start = i;
+			}
+		}
+
+		this->_segment = start;
+		this->_startSegment();
+	}
+
+	SegmentWriter::~SegmentWriter()
+	{
+		this->flush();
+		this->_close();
+	}
+
+	void SegmentWriter::_close()
+	{
+#if defined(_WIN32)
+		for (auto file : this->_files) CloseHandle(file);
+		this->_files.clear();
+#else
+		for (auto fd : this->_fds) close(fd);
+		this->_fds.clear();
+#endif
+	}
+
+	void SegmentWriter::_startSegment()
+	{
+		this->_batch_offset = 0;
+		this->_first_ns[this->_segment] = 0;
+		this->_packets[this->_segment] = 0;
+
+		auto& out = this->_batch;
+
+		/* section header, native byte order, unknown section length */
+		append32(out, BLOCK_SECTION_HEADER);
+		append32(out, 28);
+		append32(out, BYTE_ORDER_MAGIC);
+		append16(out, 1);
+		append16(out, 0);
+		append32(out, 0xffffffff);
+		append32(out, 0xffffffff);
+		append32(out, 28);
+
+		/* the interface, if_tsresol 9 */
+		append32(out, BLOCK_INTERFACE_DESCRIPTION);
+		append32(out, 32);
+		append16(out, static_cast<uint16_t>(this->_link_type));
+		append16(out, 0);
+		append32(out, this->_snap_length);
+		append16(out, OPTION_IF_TSRESOL);
+		append16(out, 1);
+		append32(out, 9);
+		append32(out, OPTION_END);
+		append32(out, 32);
+	}
+
+	void SegmentWriter::add(int64_t timestamp_ns, const uint8_t* data, uint32_t captured_length, uint32_t original_length, Direction direction)
+	{
+		std::lock_guard lock(this->_mutex);
+
+		captured_length = (std::min)(captured_length, this->_snap_length);
+
+		const uint32_t padded = (captured_length + 3u) & ~3u;
+		const uint32_t options = direction == Direction::unknown ? 0 : 12;
+		const uint32_t length = 32 + padded + options;
+
+		/* too big for any segment */
+		if (SEGMENT_HEADER_SIZE + length + PADDING_SIZE > this->_segment_size) return;
+
+		if (this->_batch_offset + this->_batch.size() + length + PADDING_SIZE > this->_segment_size)
+		{
+			this->_write();
+			this->_batch.clear();
+
+			this->_segment = (this->_segment + 1) % this->_paths.size();
+			this->_startSegment();
+		}
+
+		auto& out = this->_batch;
+		const auto ticks = static_cast<uint64_t>(timestamp_ns);
+
+		append32(out, BLOCK_ENHANCED_PACKET);
+		append32(out, length);
+		append32(out, 0);
+		append32(out, static_cast<uint32_t>(ticks >> 32));
+		append32(out, static_cast<uint32_t>(ticks));
+		append32(out, captured_length);
+		append32(out, original_length);
+		out.insert(out.end(), data, data + captured_length);
+		out.insert(out.end(), padded - captured_length, 0);
+
+		if (options)
+		{
+			append16(out, OPTION_EPB_FLAGS);
+			append16(out, 4);
+			append32(out, static_cast<uint32_t>(direction));
+			append32(out, OPTION_END);
+		}
+
+		append32(out, length);
+
+		if (this->_first_ns[this->_segment] == 0) this->_first_ns[this->_segment] = timestamp_ns;
+		this->_last_ns = timestamp_ns;
+		this->_packets[this->_segment]++;
+	}
+
+	bool SegmentWriter::flush()
+	{
+		std::lock_guard lock(this->_mutex);
+		return this->_flush();
+	}
+
+	bool SegmentWriter::_write()
+	{
+		const size_t size = this->_batch.size();
+		const uint32_t padding = this->_segment_size - this->_batch_offset - static_cast<uint32_t>(size);
+
+		/* the padding's type and length go out with the batch. its trailing length is at the end of the file */
+		append32(this->_batch, BLOCK_PADDING);
+		append32(this->_batch, padding);
+		if (padding == PADDING_SIZE) append32(this->_batch, padding);
+
+#if defined(_WIN32)
+		auto write = [this](const void* data, uint32_t length, uint32_t offset)
+		{
+			OVERLAPPED position {};
+			position.Offset = offset;
+			DWORD count = 0;
+			return WriteFile(this->_files[this->_segment], data, length, &count, &position) && count == length;
+		};
+#else
+		auto write = [this](const void* data, uint32_t length, uint32_t offset)
+		{
+			return pwrite(this->_fds[this->_segment], data, length, offset) == static_cast<ssize_t>(length);
+		};
+#endif
+
+		bool written = write(this->_batch.data(), static_cast<uint32_t>(this->_batch.size()), this->_batch_offset);
+		if (padding > PADDING_SIZE) written = write(&padding, 4, this->_segment_size - 4) && written;
+
+		this->_batch.resize(size);
+		return written;
+	}
+
+	bool SegmentWriter::_flush()
+	{
+		if (this->_batch.empty()) return true;
+
+		const bool written = this->_write();
+		this->_batch_offset += static_cast<uint32_t>(this->_batch.size());
+		this->_batch.clear();
+
+		return written;
+	}
+
+	void SegmentWriter::save(const std::filesystem::path& path)
+	{
+		std::lock_guard lock(this->_mutex);
+		this->_flush();
+
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		if (!out) throw std::runtime_error("can't create " + path.string());
+
+		for (size_t i = 1; i <= this->_paths.size(); i++)
+		{
+			const auto& segment = this->_paths[(this->_segment + i) % this->_paths.size()];
+
+			std::ifstream in(segment, std::ios::binary);
+			std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+			/* blocks up to the padding, or to the first one that doesn't add up */
+			size_t end = 0;
+			while (end + 12 <= data.size())
+			{
+				uint32_t type, length;
+				std::memcpy(&type, data.data() + end, 4);
+				std::memcpy(&length, data.data() + end + 4, 4);
+
+				if (type == BLOCK_PADDING || length < 12 || length % 4 != 0 || length > data.size() - end) break;
+				end += length;
+			}
+
+			/* just the headers, never used */
+			if (end <= SEGMENT_HEADER_SIZE) continue;
+
+			out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(end));
+		}
+
+		if (!out) throw std::runtime_error("can't write " + path.string());
+	}
+
+	int64_t SegmentWriter::getSpanNs()
+	{
+		std::lock_guard lock(this->_mutex);
+
+		int64_t first = 0;
+		for (auto ns : this->_first_ns)
+		{
+			if (ns != 0 && (first == 0 || ns < first)) first = ns;
+		}
+
+		return first ? this->_last_ns - first : 0;
+	}
+
+	uint64_t SegmentWriter::getPackets()
+	{
+		std::lock_guard lock(this->_mutex);
+
+		uint64_t packets = 0;
+		for (auto count : this->_packets) packets += count;
+
+		return packets;
+	}
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "util/net/cidr.h"
+
+/* no pch, shared by the windows and linux builds */
+
+// web https://www.tcpdump.org/manpages/pcap-savefile.5.html
+// web https://www.ietf.org/archive/id/draft-tuexen-opsawg-pcapng-05.html
+
+namespace util::pcap {
+
+	/* points into the mapped file, valid until the reader is destroyed */
+	struct Packet
+	{
+		int64_t timestamp_ns { 0 };
+		uint32_t link_type { 0 };
+
+		const uint8_t* data { nullptr };
+		uint32_t captured_length { 0 };
+		uint32_t original_length { 0 };
+	};
+
+	/* the ip/transport part of a packet */
+	struct Datagram
+	{
+		util::net::Address source;
+		util::net::Address destination;
+
+		/* IPPROTO_* */
+		uint8_t protocol { 0 };
+
+		/* 0 if not tcp/udp, or the header was cut off */
+		uint16_t source_port { 0 };
+		uint16_t destination_port { 0 };
+
+		/* ip total length as sent */
+		uint32_t length { 0 };
+	};
+
+	/* ethernet (+vlan), raw ip, linux cooked v1/v2 and bsd loopback. nullopt for anything else */
+	std::optional<Datagram> decode(const Packet& packet);
+
+	/*
+		streams packets out of a pcap or pcapng file
+		the file is mapped, not read, so it is only touched once and never copied
+		throws std::runtime_error if the file can't be opened or isn't a capture
+	*/
+	class Reader
+	{
+		public:
+			Reader(const std::filesystem::path& path);
+			~Reader();
+
+			Reader(const Reader&) = delete;
+			Reader& operator=(const Reader&) = delete;
+
+			/* false at the end of the file, or at the first truncated record */
+			bool next(Packet& packet);
+
+			size_t getSize() const { return this->_size; }
+			size_t getOffset() const { return this->_offset; }
+
+		private:
+			/* safe to call more than once */
+			void _unmap();
+
+			bool _nextPcap(Packet& packet);
+			bool _nextPcapng(Packet& packet);
+
+			/* section header, sets byte order and forgets the interfaces */
+			bool _readSectionHeader();
+
+			uint16_t _read16(size_t offset) const;
+			uint32_t _read32(size_t offset) const;
+
+			const uint8_t* _data { nullptr };
+			size_t _size { 0 };
+			size_t _offset { 0 };
+
+			bool _pcapng { false };
+			bool _swapped { false };
+
+			/* classic pcap file header */
+			uint32_t _link_type { 0 };
+			bool _nanosecond { false };
+
+			/* pcapng interfaces of the current section */
+			struct Interface
+			{
+				uint32_t link_type;
+
+				/* ticks per second of the timestamps */
+				uint64_t resolution;
+			};
+			std::vector<Interface> _interfaces;
+
+#if defined(_WIN32)
+			void* _file { nullptr };
+			void* _mapping { nullptr };
+#endif
+	};
+
+	/* epb_flags direction of a written packet */
+	enum class Direction : uint32_t
+	{
+		unknown = 0,
+		inbound = 1,
+		outbound = 2,
+	};
+
+	/*
+		rolling pcapng capture in a fixed set of preallocated segment files, segment-0.pcapng and on
+		a full segment moves on to the next, and the oldest is written over in place, so the disk use never changes.
+		the unwritten rest of a segment is one block readers skip, so every segment is a valid capture at any time
+		packets are batched in memory, flush writes the batch with one call.
+		only one process opens a directory, throws std::runtime_error if it's taken or the files can't be made
+	*/
+	class SegmentWriter
+	{
+		public:
+			SegmentWriter(const std::filesystem::path& directory, uint32_t segments, uint32_t segment_size, uint32_t link_type, uint32_t snap_length);
+			~SegmentWriter();
+
+			SegmentWriter(const SegmentWriter&) = delete;
+			SegmentWriter& operator=(const SegmentWriter&) = delete;
+
+			/* cut to the snap length. flushes first if the packet doesn't fit the batch's segment */
+			void add(int64_t timestamp_ns, const uint8_t* data, uint32_t captured_length, uint32_t original_length, Direction direction);
+
+			/* false on a write error, the batch is dropped either way */
+			bool flush();
+
+			/* every segment, oldest first, into one file of one section each. the padding is left out */
+			void save(const std::filesystem::path& path);
+
+			/* of the packets still in the segments, written by this process */
+			int64_t getSpanNs();
+			uint64_t getPackets();
+
+		private:
+			/* section and interface header of a fresh segment, into the batch */
+			void _startSegment();
+
+			/* batch and the padding after it at _batch_offset, and the padding's trailing length at the end */
+			bool _write();
+
+			/* _write, and the next batch starts after this one */
+			bool _flush();
+
+			/* safe to call more than once */
+			void _close();
+
+			std::mutex _mutex;
+
+			std::vector<std::filesystem::path> _paths;
+			uint32_t _segment_size;
+			uint32_t _link_type;
+			uint32_t _snap_length;
+
+			/* segment being written, and where its batch starts */
+			uint32_t _segment { 0 };
+			uint32_t _batch_offset { 0 };
+			std::vector<uint8_t> _batch;
+
+			/* first packet and packet count of each segment, from this process */
+			std::vector<int64_t> _first_ns;
+			std::vector<uint64_t> _packets;
+			int64_t _last_ns { 0 };
+
+#if defined(_WIN32)
+			std::vector<void*> _files;
+#else
+			std::vector<int> _fds;
+#endif
+	};
+}
@@ -0,0 +1,96 @@
+#include "Packet.h"
+
+namespace util::ping {
+
+	namespace {
+		uint16_t read16(std::span<const uint8_t> data, size_t offset)
+		{
+			return static_cast<uint16_t>((data[offset] << 8) | data[offset + 1]);
+		}
+
+		void write16(std::span<uint8_t> data, size_t offset, uint16_t value)
+		{
+			data[offset] = static_cast<uint8_t>(value >> 8);
+			data[offset + 1] = static_cast<uint8_t>(value);
+		}
+
+		/* what follows an ipv4 header carrying protocol, empty if there is no such header */
+		std::span<const uint8_t> skipIpv4Header(std::span<const uint8_t> data, uint8_t protocol)
+		{
+			if (data.size() < 20 || (data[0] >> 4) != 4) return {};
+
+			const size_t header_length = (data[0] & 0x0F) * 4u;
+			if (header_length < 20 || data.size() < header_length || data[9] != protocol) return {};
+
+			return data.subspan(header_length);
+		}
+	}
+
+	EchoRequest::EchoRequest(uint8_t type, uint16_t identifier, bool checksum) :
+		_checksum(checksum)
+	{
+		this->_bytes[0] = type;
+		this->_bytes[1] = 0; // code
+		write16(this->_bytes, 4, identifier);
+
+		for (size_t i = 0; i < sizeof(__body) - 1; i++)
+		{
+			this->_bytes[__header_size + i] = static_cast<uint8_t>(__body[i]);
+		}
+
+		/* checksum and sequence are still zero */
+		for (size_t i = 0; i < __size; i += 2)
+		{
+			this->_partial_sum += static_cast<uint32_t>(this->_bytes[i] << 8);
+			if (i + 1 < __size) this->_partial_sum += this->_bytes[i + 1];
+		}
+	}
+
+	void EchoRequest::setSequence(uint16_t sequence)
+	{
+		write16(this->_bytes, 6, sequence);
+
+		if (!this->_checksum) return;
+
+		uint32_t sum = this->_partial_sum + sequence;
+		sum = (sum >> 16) + (sum & 0xFFFF);
+		sum += (sum >> 16);
+		write16(this->_bytes, 2, static_cast<uint16_t>(~sum));
+	}
+
+	std::optional<EchoReply> parseEchoReply(std::span<const uint8_t> data, bool ipv4_header)
+	{
+		if (ipv4_header) data = skipIpv4Header(data, 1 /* icmp */);
+
+		if (data.size() < 8) return std::nullopt;
+
+		return EchoReply { data[0], read16(data, 4), read16(data, 6) };
+	}
+
+	std::optional<QuotedEcho> parseQuotedEcho(std::span<const uint8_t> data, bool ipv4_header, bool v6)
+	{
+		if (ipv4_header) data = skipIpv4Header(data, 1 /* icmp */);
+
+		if (data.size() < 8) return std::nullopt;
+
+		const uint8_t type = data[0];
+		const uint8_t code = data[1];
+
+		/* the error's header, then as much of our packet as the router kept. the rfcs ask for at least 8 bytes past its ip header */
+		auto quoted = data.subspan(8);
+
+		if (v6)
+		{
+			if (quoted.size() < 40 || (quoted[0] >> 4) != 6 || quoted[6] != 58 /* icmpv6 */) return std::nullopt;
+			quoted = quoted.subspan(40);
+		}
+		else
+		{
+			quoted = skipIpv4Header(quoted, 1 /* icmp */);
+		}
+
+		if (quoted.size() < 8 || quoted[0] != (v6 ? EchoType::request_v6 : EchoType::request_v4)) return std::nullopt;
+
+		return QuotedEcho { type, code, read16(quoted, 4), read16(quoted, 6) };
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+/* no pch, shared by the windows and linux builds */
+
+namespace util::ping {
+
+	/* icmp types we send and expect back, per family */
+	struct EchoType
+	{
+		static constexpr uint8_t request_v4 { 8 };
+		static constexpr uint8_t reply_v4 { 0 };
+		static constexpr uint8_t request_v6 { 128 };
+		static constexpr uint8_t reply_v6 { 129 };
+	};
+
+	/* icmp errors that can quote one of our requests, per family */
+	struct ErrorType
+	{
+		static constexpr uint8_t unreachable_v4 { 3 };
+		static constexpr uint8_t time_exceeded_v4 { 11 };
+		static constexpr uint8_t unreachable_v6 { 1 };
+		static constexpr uint8_t time_exceeded_v6 { 3 };
+
+		/* codes of the unreachables */
+		static constexpr uint8_t port_unreachable_v4 { 3 };
+		static constexpr uint8_t port_unreachable_v6 { 4 };
+	};
+
+	/*
+		an echo request encoded once, only the sequence and checksum change between sends
+		the checksum is patched from a precomputed sum of everything else
+	*/
+	class EchoRequest
+	{
+		/* consts */
+		private:
+			static constexpr char __body[] { "\"Hello!\" from Asio ping." };
+			static constexpr size_t __header_size { 8 };
+
+		public:
+			static constexpr size_t __size { __header_size + sizeof(__body) - 1 };
+
+		public:
+			/* the kernel fills in the icmpv6 checksum, it covers a pseudo header we don't have */
+			EchoRequest(uint8_t type, uint16_t identifier, bool checksum);
+
+			void setSequence(uint16_t sequence);
+
+			std::span<const uint8_t> data() const { return this->_bytes; }
+
+		private:
+			std::array<uint8_t, __size> _bytes {};
+			bool _checksum;
+
+			/* ones' complement sum of the packet without sequence and checksum, not folded */
+			uint32_t _partial_sum { 0 };
+	};
+
+	struct EchoReply
+	{
+		uint8_t type;
+		uint16_t identifier;
+		uint16_t sequence;
+	};
+
+	/*
+		reads the icmp header straight out of a receive buffer
+		skips the ipv4 header first if the socket delivers it. nullopt if truncated or not icmp
+	*/
+	std::optional<EchoReply> parseEchoReply(std::span<const uint8_t> data, bool ipv4_header);
+
+	/* an icmp error, and the echo request it quotes */
+	struct QuotedEcho
+	{
+		uint8_t type;
+		uint8_t code;
+		uint16_t identifier;
+		uint16_t sequence;
+	};
+
+	/* like parseEchoReply, for the errors raw sockets get. nullopt if it doesn't quote an echo request of this family */
+	std::optional<QuotedEcho> parseQuotedEcho(std::span<const uint8_t> data, bool ipv4_header, bool v6);
+}
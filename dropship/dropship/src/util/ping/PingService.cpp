@@ -0,0 +1,1079 @@
+#include "PingService.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <netinet/in.h>
+#include <netinet/icmp6.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace util::ping {
+
+	namespace {
+		/* same clock as kernel software timestamps */
+		int64_t realtimeNs()
+		{
+			return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+		}
+
+#if !defined(_WIN32)
+		/* SCM_TIMESTAMPING (software stamp comes first) or SCM_TIMESTAMPNS */
+		std::optional<int64_t> kernelTimestamp(msghdr& msg)
+		{
+			for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+			{
+				if (cmsg->cmsg_level != SOL_SOCKET || (cmsg->cmsg_type != SCM_TIMESTAMPING && cmsg->cmsg_type != SCM_TIMESTAMPNS)) continue;
+
+				timespec ts;
+				std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+				if (ts.tv_sec == 0 && ts.tv_nsec == 0) continue;
+
+				return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+			}
+
+			return std::nullopt;
+		}
+
+		std::optional<sock_extended_err> extendedError(msghdr& msg)
+		{
+			for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+			{
+				if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+					&& !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) continue;
+
+				sock_extended_err extended;
+				std::memcpy(&extended, CMSG_DATA(cmsg), sizeof(extended));
+				return extended;
+			}
+
+			return std::nullopt;
+		}
+
+		/* SO_EE_OFFENDER, the host that sent the icmp error. it follows the extended error in the same cmsg */
+		std::optional<asio::ip::address> errorOffender(msghdr& msg)
+		{
+			for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+			{
+				if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+					&& !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) continue;
+
+				const auto data = CMSG_DATA(cmsg) + sizeof(sock_extended_err);
+				const size_t length = cmsg->cmsg_len - CMSG_LEN(sizeof(sock_extended_err));
+
+				sa_family_t family;
+				if (length < sizeof(family)) return std::nullopt;
+				std::memcpy(&family, data, sizeof(family));
+
+				if (family == AF_INET && length >= sizeof(sockaddr_in))
+				{
+					sockaddr_in offender;
+					std::memcpy(&offender, data, sizeof(offender));
+					return asio::ip::address_v4(ntohl(offender.sin_addr.s_addr));
+				}
+
+				if (family == AF_INET6 && length >= sizeof(sockaddr_in6))
+				{
+					sockaddr_in6 offender;
+					std::memcpy(&offender, data, sizeof(offender));
+
+					asio::ip::address_v6::bytes_type bytes;
+					std::memcpy(bytes.data(), &offender.sin6_addr, bytes.size());
+					return asio::ip::address_v6(bytes);
+				}
+
+				return std::nullopt;
+			}
+
+			return std::nullopt;
+		}
+#endif
+	}
+
+	PingService::PingService(size_t threads) :
+		_work(asio::make_work_guard(_io_context)),
+		_strand(asio::make_strand(_io_context)),
+		_v4(_strand, false, false),
+		_v6(_strand, true, false),
+		_v4_unreachable(_strand, false, true),
+		_v6_unreachable(_strand, true, true),
+		_tick_timer(_strand)
+	{
+		/* other programs on the host use pid based identifiers, pick something else */
+		this->_identifier = static_cast<uint16_t>(std::random_device {}());
+
+		for (auto channel : { &this->_v4, &this->_v6, &this->_v4_unreachable, &this->_v6_unreachable })
+		{
+			asio::error_code ignored;
+
+			if (channel->unreachable)
+			{
+#if !defined(_WIN32)
+				this->_openUnreachable(*channel);
+				channel->udp.set_option(asio::socket_base::receive_buffer_size(__receive_buffer), ignored);
+#endif
+			}
+			else
+			{
+				this->_open(*channel);
+				channel->socket.set_option(asio::socket_base::receive_buffer_size(__receive_buffer), ignored);
+			}
+
+			channel->burst.reserve(__max_targets);
+#if !defined(_WIN32)
+			channel->send_iovecs.resize(__max_targets);
+			channel->send_messages.resize(__max_targets);
+			channel->send_controls.resize(__max_targets);
+#endif
+
+			if (channel->isOpen())
+			{
+				asio::post(this->_strand, [this, channel] { this->_startReceive(*channel); });
+			}
+		}
+
+		for (size_t i = 0; i < std::max<size_t>(threads, 1); i++)
+		{
+			this->_threads.push_back(std::async(std::launch::async, [this]
+			{
+				try {
+					this->_io_context.run();
+				}
+				catch (std::exception& e)
+				{
+					std::cerr << "Exception: " << e.what() << std::endl;
+				}
+			}));
+		}
+	}
+
+	PingService::~PingService()
+	{
+		asio::post(this->_strand, [this]
+		{
+			std::lock_guard lock(this->_targets_mutex);
+
+			for (auto& target : this->_slots)
+			{
+				/* their pending connects and receives hold on to them */
+				if (target)
+				{
+					asio::error_code ignored;
+					target->tcp.close(ignored);
+					target->udp.close(ignored);
+				}
+
+				target.reset();
+			}
+
+			this->_tick_timer.cancel();
+
+			asio::error_code ignored;
+			for (auto channel : { &this->_v4, &this->_v6, &this->_v4_unreachable, &this->_v6_unreachable })
+			{
+				channel->socket.close(ignored);
+				channel->udp.close(ignored);
+			}
+		});
+
+		/* run() returns once the timers and the receives have drained */
+		this->_work.reset();
+
+		for (auto& thread : this->_threads)
+		{
+			thread.get();
+		}
+	}
+
+	TargetId PingService::add(const std::string& address, Probe probe)
+	{
+		/* literal addresses pick their own family, names resolve to ipv4 like before */
+		icmp::endpoint destination;
+		asio::error_code error;
+		const auto literal = asio::ip::make_address(address, error);
+
+		if (!error)
+		{
+			destination = icmp::endpoint(literal, 0);
+		}
+		else
+		{
+			icmp::resolver resolver(this->_io_context);
+			destination = *resolver.resolve(icmp::v4(), address, "").begin();
+		}
+
+		const bool v6 = destination.address().is_v6();
+
+#if defined(_WIN32)
+		if (probe.ttl && probe.method != Method::icmp) throw std::runtime_error("only icmp probes take a ttl");
+#else
+		if (probe.ttl && probe.method != Method::icmp && probe.method != Method::unreachable) throw std::runtime_error("only icmp and unreachable probes take a ttl");
+#endif
+
+		if (probe.method == Method::automatic && !this->isAvailable(v6)) probe.method = Method::tcp;
+		if (probe.method == Method::icmp && !this->isAvailable(v6)) throw std::runtime_error(v6 ? "no icmpv6 socket" : "no icmp socket");
+
+#if !defined(_WIN32)
+		if (probe.method == Method::unreachable && !(v6 ? this->_v6_unreachable : this->_v4_unreachable).isOpen()) throw std::runtime_error("no udp socket");
+#endif
+
+		const EchoRequest request(v6 ? EchoType::request_v6 : EchoType::request_v4, this->_identifier, !v6);
+
+		TargetId id;
+		std::shared_ptr<Target> target;
+		{
+			std::lock_guard lock(this->_targets_mutex);
+
+			auto free_slot = std::find(this->_slots_taken.begin(), this->_slots_taken.end(), false);
+			if (free_slot == this->_slots_taken.end()) throw std::runtime_error("too many ping targets");
+			*free_slot = true;
+
+			const size_t slot = static_cast<size_t>(free_slot - this->_slots_taken.begin());
+
+			/* the port unreachable quotes our destination port, which leads back to the slot */
+			if (probe.method == Method::unreachable)
+			{
+				probe.port = static_cast<uint16_t>(__unreachable_port + slot);
+				destination.port(probe.port);
+			}
+
+			target = std::make_shared<Target>(this->_strand, destination, slot, request, probe);
+
+			id = this->_next_id++;
+			this->_targets[id] = target;
+		}
+
+		/* first probe right away, unless paused */
+		asio::post(this->_strand, [this, target]
+		{
+			this->_slots[target->slot] = target;
+
+			target->next_probe = chrono::steady_clock::now();
+			if (this->_isProbed(*target)) this->_tick();
+		});
+
+		return id;
+	}
+
+	void PingService::remove(TargetId id)
+	{
+		std::shared_ptr<Target> target;
+		{
+			std::lock_guard lock(this->_targets_mutex);
+
+			auto it = this->_targets.find(id);
+			if (it == this->_targets.end()) return;
+
+			target = it->second;
+			this->_targets.erase(it);
+		}
+
+		asio::post(this->_strand, [this, target]
+		{
+			asio::error_code ignored;
+			target->tcp.close(ignored);
+			target->udp.close(ignored);
+
+			this->_slots[target->slot].reset();
+
+			std::lock_guard lock(this->_targets_mutex);
+			this->_slots_taken[target->slot] = false;
+		});
+	}
+
+	std::optional<int> PingService::getPing(TargetId id)
+	{
+		const auto statistics = this->getStatistics(id);
+		if (!statistics || statistics->samples == 0) return std::nullopt;
+
+		return statistics->last < 0.0f ? -1 : static_cast<int>(std::lround(statistics->last));
+	}
+
+	std::optional<Method> PingService::getMethod(TargetId id)
+	{
+		std::lock_guard lock(this->_targets_mutex);
+
+		auto it = this->_targets.find(id);
+		if (it == this->_targets.end()) return std::nullopt;
+
+		return it->second->method.load();
+	}
+
+	std::optional<asio::ip::address> PingService::getResponder(TargetId id)
+	{
+		Responder responder;
+		{
+			std::lock_guard lock(this->_targets_mutex);
+
+			auto it = this->_targets.find(id);
+			if (it == this->_targets.end()) return std::nullopt;
+
+			responder = it->second->responder.load();
+		}
+
+		if (!responder.known) return std::nullopt;
+		if (responder.v6) return asio::ip::address_v6(responder.bytes);
+
+		return asio::ip::address_v4({ responder.bytes[0], responder.bytes[1], responder.bytes[2], responder.bytes[3] });
+	}
+
+	void PingService::setPaused(bool paused)
+	{
+		if (this->_paused.exchange(paused) == paused) return;
+
+		asio::post(this->_strand, [this, paused]
+		{
+			this->_ticking = !paused;
+
+			const auto now = chrono::steady_clock::now();
+
+			for (auto& target : this->_slots)
+			{
+				if (!target || target->while_paused) continue;
+
+				/* a reply that comes in later is dropped, resuming doesn't find it lost */
+				this->_abandon(*target);
+				target->next_probe = now;
+			}
+
+			/* paused, the timer only wakes for the targets that don't pause */
+			if (paused)
+				this->_schedule(now);
+			else
+				this->_tick();
+		});
+	}
+
+	void PingService::reprobe()
+	{
+		asio::post(this->_strand, [this]
+		{
+			const auto now = chrono::steady_clock::now();
+
+			for (auto& target : this->_slots)
+			{
+				if (!target) continue;
+
+				this->_abandon(*target);
+
+				/* the old path's samples say nothing about the new one */
+				target->samples = {};
+				target->statistics.store(target->samples.compute());
+				target->responder.store({});
+				target->fast_probes = __fast_probes;
+				target->next_probe = now;
+
+				/* icmp may get through on this network */
+				if (target->automatic && this->isAvailable(target->v6))
+				{
+					target->method = Method::icmp;
+					target->unanswered = 0;
+				}
+			}
+
+			this->_tick();
+		});
+	}
+
+	std::optional<Statistics> PingService::getStatistics(TargetId id)
+	{
+		std::lock_guard lock(this->_targets_mutex);
+
+		auto it = this->_targets.find(id);
+		if (it == this->_targets.end()) return std::nullopt;
+
+		return it->second->statistics.load();
+	}
+
+	PingService::Channel& PingService::_channel(const Target& target)
+	{
+		if (target.method == Method::unreachable) return target.v6 ? this->_v6_unreachable : this->_v4_unreachable;
+
+		return target.v6 ? this->_v6 : this->_v4;
+	}
+
+	void PingService::_open(Channel& channel)
+	{
+		const auto protocol = channel.v6 ? icmp::v6() : icmp::v4();
+		asio::error_code error;
+
+#if !defined(_WIN32)
+		/* no privileges needed if our group is in net.ipv4.ping_group_range, which covers ipv6 too */
+		const int fd = ::socket(protocol.family(), SOCK_DGRAM | SOCK_CLOEXEC, protocol.protocol());
+		if (fd >= 0)
+		{
+			channel.socket.assign(protocol, fd, error);
+			if (!error)
+			{
+				channel.datagram = true;
+				this->_enableTimestamps(channel, channel.socket.native_handle());
+				this->_enableErrors(channel, channel.socket.native_handle());
+				return;
+			}
+			::close(fd);
+		}
+#endif
+
+		channel.socket.open(protocol, error);
+		if (error)
+		{
+			std::cerr << "ping: no " << (channel.v6 ? "icmpv6" : "icmp") << " socket: " << error.message() << std::endl;
+			return;
+		}
+
+#if defined(_WIN32)
+		asio::ip::unicast::hops hops;
+		channel.socket.get_option(hops, error);
+		if (!error) channel.default_hops = hops.value();
+#else
+		/* a raw icmpv6 socket also gets neighbour discovery and router traffic. the errors can quote our requests */
+		if (channel.v6)
+		{
+			icmp6_filter filter;
+			ICMP6_FILTER_SETBLOCKALL(&filter);
+			ICMP6_FILTER_SETPASS(EchoType::reply_v6, &filter);
+			ICMP6_FILTER_SETPASS(ErrorType::unreachable_v6, &filter);
+			ICMP6_FILTER_SETPASS(ErrorType::time_exceeded_v6, &filter);
+			setsockopt(channel.socket.native_handle(), IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter));
+		}
+
+		this->_enableTimestamps(channel, channel.socket.native_handle());
+#endif
+	}
+
+#if !defined(_WIN32)
+	void PingService::_openUnreachable(Channel& channel)
+	{
+		asio::error_code error;
+		channel.udp.open(channel.v6 ? asio::ip::udp::v6() : asio::ip::udp::v4(), error);
+		if (error)
+		{
+			std::cerr << "ping: no " << (channel.v6 ? "udp6" : "udp") << " socket: " << error.message() << std::endl;
+			return;
+		}
+
+		channel.datagram = true;
+		this->_enableTimestamps(channel, channel.udp.native_handle());
+		this->_enableErrors(channel, channel.udp.native_handle());
+	}
+
+	void PingService::_enableErrors(Channel& channel, int fd)
+	{
+		/* icmp errors go to the error queue with the datagram that caused them, instead of failing the next call */
+		const int on = 1;
+		channel.recverr = channel.v6
+			? setsockopt(fd, IPPROTO_IPV6, IPV6_RECVERR, &on, sizeof(on)) == 0
+			: setsockopt(fd, IPPROTO_IP, IP_RECVERR, &on, sizeof(on)) == 0;
+	}
+
+	void PingService::_enableTimestamps(Channel& channel, int fd)
+	{
+		/* software stamps both ways. transmit stamps come without the packet, keyed by send count */
+		const int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE
+			| SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+
+		if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0)
+		{
+			channel.rx_timestamps = true;
+			channel.tx_timestamps = true;
+			return;
+		}
+
+		const int on = 1;
+		channel.rx_timestamps = setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+	}
+#endif
+
+	void PingService::_tick()
+	{
+		const auto now = chrono::steady_clock::now();
+
+		for (auto channel : { &this->_v4, &this->_v6, &this->_v4_unreachable, &this->_v6_unreachable })
+		{
+			channel->burst.clear();
+		}
+
+		size_t unreachable_sent = 0;
+		std::optional<size_t> held_back;
+
+		for (size_t i = 0; i < __max_targets; i++)
+		{
+			const size_t slot = (this->_tick_start + i) % __max_targets;
+			auto& target = this->_slots[slot];
+
+			if (!target || !this->_isProbed(*target)) continue;
+
+			/* close enough counts as due, so targets on the same interval stay in one burst */
+			if (target->next_probe > now + __fast_interval / 2) continue;
+			if (target->waiting && now - target->time_sent < __timeout) continue;
+
+			if (target->method == Method::unreachable && unreachable_sent++ >= __unreachable_burst)
+			{
+				if (!held_back) held_back = slot;
+				continue;
+			}
+
+			if (target->waiting)
+			{
+				target->waiting = false;
+				this->_record(*target, std::nullopt, std::nullopt);
+
+				/* icmp is probably filtered. start the window over so its losses don't count against tcp */
+				if (target->automatic && target->method == Method::icmp && ++target->unanswered >= __fallback_probes)
+				{
+					target->method = Method::tcp;
+					target->samples = {};
+					target->statistics.store(target->samples.compute());
+				}
+			}
+
+			this->_pace(*target, now);
+
+			switch (target->method.load())
+			{
+				case Method::tcp:
+					this->_connect(target);
+					break;
+
+				case Method::udp:
+					this->_sendDatagram(target);
+					break;
+
+#if defined(_WIN32)
+				case Method::unreachable:
+					this->_sendDatagram(target);
+					break;
+#endif
+
+				default:
+					this->_channel(*target).burst.push_back(target.get());
+			}
+		}
+
+		this->_tick_start = held_back.value_or(this->_tick_start);
+
+		for (auto channel : { &this->_v4, &this->_v6, &this->_v4_unreachable, &this->_v6_unreachable })
+		{
+			if (!channel->burst.empty()) this->_send(*channel, channel->burst);
+		}
+
+		this->_schedule(now);
+	}
+
+	void PingService::_schedule(chrono::steady_clock::time_point now)
+	{
+		auto next = chrono::steady_clock::time_point::max();
+
+		for (auto& target : this->_slots)
+		{
+			if (target && this->_isProbed(*target)) next = std::min(next, target->next_probe);
+		}
+
+		/* no targets, no wakeups */
+		if (next == chrono::steady_clock::time_point::max())
+		{
+			this->_tick_timer.cancel();
+			return;
+		}
+
+		/* targets held back, or with a probe still out, are due already. don't spin on them */
+		this->_tick_timer.expires_at(std::max(next, now + __fast_interval));
+		this->_tick_timer.async_wait([this](const asio::error_code& error) { if (!error) this->_tick(); });
+	}
+
+	void PingService::_pace(Target& target, chrono::steady_clock::time_point now)
+	{
+		if (target.fast_probes > 0)
+		{
+			target.fast_probes--;
+			target.interval = __fast_interval;
+		}
+		else
+		{
+			const auto statistics = target.samples.compute();
+			const bool steady = statistics.last >= 0.0f && statistics.samples >= __fast_probes
+				&& std::fabs(statistics.last - statistics.p50) <= std::max(__steady_ms, 2.0f * statistics.jitter);
+
+			/* anything off and it's back to the normal interval */
+			target.interval = steady
+				? std::min<chrono::steady_clock::duration>(std::max<chrono::steady_clock::duration>(target.interval * 2, __interval), __max_interval)
+				: chrono::steady_clock::duration(__interval);
+		}
+
+		target.next_probe = now + target.interval;
+	}
+
+	void PingService::_abandon(Target& target)
+	{
+		target.waiting = false;
+
+		/* the cancelled connect sees a new round. unreachable targets on windows just ignore what comes back */
+		target.round++;
+
+		asio::error_code ignored;
+		target.tcp.close(ignored);
+	}
+
+	void PingService::_send(Channel& channel, std::span<Target* const> targets)
+	{
+		const auto time_sent = steady_timer::clock_type::now();
+		this->_probes.fetch_add(targets.size(), std::memory_order_relaxed);
+
+		for (auto target : targets)
+		{
+			/* a reply to an earlier probe won't match the new round */
+			target->round++;
+			target->sequence = static_cast<uint16_t>((target->round << __slot_bits) | target->slot);
+			target->request.setSequence(target->sequence);
+
+			target->time_sent = time_sent;
+			target->waiting = true;
+			target->kernel_sent_ns.reset();
+		}
+
+#if defined(_WIN32)
+		for (auto target : targets)
+		{
+			const auto request = target->request.data();
+			asio::error_code ignored;
+
+			/* no per send ttl here, set it around the send */
+			if (target->ttl) channel.socket.set_option(asio::ip::unicast::hops(target->ttl), ignored);
+
+			const int64_t before = realtimeNs();
+			channel.socket.send_to(asio::buffer(request.data(), request.size()), target->destination, 0, ignored);
+			const int64_t after = realtimeNs();
+
+			if (target->ttl) channel.socket.set_option(asio::ip::unicast::hops(channel.default_hops), ignored);
+
+			target->sent_ns = before + (after - before) / 2;
+			target->sent_error_ns = (after - before) / 2;
+		}
+#else
+		/* a pending icmp error fails the next send instead of sending it. reading the error queue clears it */
+		if (channel.recverr) this->_drainErrorQueue(channel);
+
+		for (size_t i = 0; i < targets.size(); i++)
+		{
+			const auto request = targets[i]->request.data();
+			channel.send_iovecs[i] = { const_cast<uint8_t*>(request.data()), request.size() };
+
+			auto& header = channel.send_messages[i].msg_hdr;
+			header = {};
+			header.msg_name = const_cast<sockaddr*>(targets[i]->destination.data());
+			header.msg_namelen = static_cast<socklen_t>(targets[i]->destination.size());
+			header.msg_iov = &channel.send_iovecs[i];
+			header.msg_iovlen = 1;
+
+			/* the ttl rides along with each message, so hops of one path go out in the same burst */
+			if (targets[i]->ttl)
+			{
+				auto& control = channel.send_controls[i];
+				header.msg_control = control.data();
+				header.msg_controllen = control.size();
+
+				cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+				cmsg->cmsg_level = channel.v6 ? SOL_IPV6 : SOL_IP;
+				cmsg->cmsg_type = channel.v6 ? IPV6_HOPLIMIT : IP_TTL;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+
+				const int ttl = targets[i]->ttl;
+				std::memcpy(CMSG_DATA(cmsg), &ttl, sizeof(ttl));
+			}
+		}
+
+		const int64_t before = realtimeNs();
+
+		for (size_t next = 0; next < targets.size();)
+		{
+			const int sent = sendmmsg(channel.unreachable ? channel.udp.native_handle() : channel.socket.native_handle(), &channel.send_messages[next], static_cast<unsigned>(targets.size() - next), 0);
+			if (sent < 0 && errno == EINTR) continue;
+
+			/* sendmmsg stops at the first failure. skip that one and carry on with the rest */
+			const size_t count = sent > 0 ? static_cast<size_t>(sent) : 1;
+
+			/* the kernel counts a send once the packet is built, routing failures come before that */
+			const bool counted = sent > 0 || (errno != ENETUNREACH && errno != EHOSTUNREACH);
+
+			if (channel.tx_timestamps && counted)
+			{
+				for (size_t i = next; i < next + count; i++)
+				{
+					targets[i]->tx_key = channel.tx_key++;
+					channel.tx_slots[targets[i]->tx_key % __max_targets] = static_cast<uint16_t>(targets[i]->slot);
+				}
+			}
+
+			next += count;
+		}
+
+		const int64_t after = realtimeNs();
+
+		for (auto target : targets)
+		{
+			target->sent_ns = before + (after - before) / 2;
+			target->sent_error_ns = (after - before) / 2;
+		}
+#endif
+	}
+
+	void PingService::_connect(const std::shared_ptr<Target>& target)
+	{
+		/* a connect still pending from the last tick is cancelled, its handler sees the old round */
+		asio::error_code ignored;
+		target->tcp.close(ignored);
+
+		target->round++;
+		target->time_sent = chrono::steady_clock::now();
+		target->waiting = true;
+		this->_probes.fetch_add(1, std::memory_order_relaxed);
+
+		asio::error_code error;
+		target->tcp.open(target->v6 ? asio::ip::tcp::v6() : asio::ip::tcp::v4(), error);
+
+		/* out of descriptors or the like, the next tick counts it lost */
+		if (error) return;
+
+		target->tcp.async_connect(asio::ip::tcp::endpoint(target->destination.address(), target->port),
+			[this, target, round = target->round](const asio::error_code& error) { this->_handleConnect(*target, round, error); });
+	}
+
+	void PingService::_handleConnect(Target& target, uint16_t round, const asio::error_code& error)
+	{
+		if (error == asio::error::operation_aborted || round != target.round || !target.waiting) return;
+
+		/* a syn retransmit or worse. the next tick counts it lost and closes the socket */
+		const chrono::duration<float, std::milli> elapsed = chrono::steady_clock::now() - target.time_sent;
+		if (elapsed > __timeout) return;
+
+		target.waiting = false;
+
+		std::optional<float> rtt_ms;
+		std::optional<float> error_ms;
+
+		if (!error)
+		{
+			rtt_ms = elapsed.count();
+
+#if !defined(_WIN32)
+			/* the kernel timed the handshake, in microseconds */
+			tcp_info info {};
+			socklen_t length = sizeof(info);
+			if (getsockopt(target.tcp.native_handle(), IPPROTO_TCP, TCP_INFO, &info, &length) == 0 && info.tcpi_rtt > 0)
+			{
+				rtt_ms = info.tcpi_rtt / 1000.0f;
+				error_ms = 0.001f;
+			}
+#endif
+		}
+		/* a closed port answers with a reset, that's a round trip too. anything else came from a router or nowhere */
+		else if (error == asio::error::connection_refused)
+		{
+			rtt_ms = elapsed.count();
+		}
+
+		/* reset instead of fin, so thousands of probes don't pile up in time wait */
+		asio::error_code ignored;
+		target.tcp.set_option(asio::socket_base::linger(true, 0), ignored);
+		target.tcp.close(ignored);
+
+		this->_record(target, rtt_ms, error_ms);
+	}
+
+	void PingService::_sendDatagram(const std::shared_ptr<Target>& target)
+	{
+		target->round++;
+		target->time_sent = chrono::steady_clock::now();
+		target->waiting = true;
+		this->_probes.fetch_add(1, std::memory_order_relaxed);
+
+		/* connected, so the kernel hands us the port unreachable as an error */
+		if (!target->udp.is_open())
+		{
+			asio::error_code error;
+			target->udp.open(target->v6 ? asio::ip::udp::v6() : asio::ip::udp::v4(), error);
+			if (!error) target->udp.connect(asio::ip::udp::endpoint(target->destination.address(), target->port), error);
+
+			if (error)
+			{
+				asio::error_code ignored;
+				target->udp.close(ignored);
+				return;
+			}
+
+			this->_startDatagramReceive(target);
+		}
+
+		/* the echo request is as good a payload as any */
+		asio::error_code ignored;
+		target->udp.send(asio::buffer(target->request.data().data(), target->request.data().size()), 0, ignored);
+	}
+
+	void PingService::_startDatagramReceive(const std::shared_ptr<Target>& target)
+	{
+		target->udp.async_receive(asio::buffer(target->datagram_buffer),
+			[this, target](const asio::error_code& error, std::size_t) { this->_handleDatagram(target, error); });
+	}
+
+	void PingService::_handleDatagram(const std::shared_ptr<Target>& target, const asio::error_code& error)
+	{
+		if (error == asio::error::operation_aborted || !target->udp.is_open()) return;
+
+		/* windows reports the port unreachable as a reset */
+		const bool answered = !error || error == asio::error::connection_refused || error == asio::error::connection_reset;
+
+		/* nothing to match a reply against. one that comes after its tick counts for the next probe */
+		const chrono::duration<float, std::milli> elapsed = chrono::steady_clock::now() - target->time_sent;
+
+		if (answered && target->waiting && elapsed <= __timeout)
+		{
+			target->waiting = false;
+			this->_record(*target, elapsed.count(), std::nullopt);
+		}
+
+		this->_startDatagramReceive(target);
+	}
+
+	void PingService::_record(Target& target, std::optional<float> rtt_ms, std::optional<float> error_ms)
+	{
+		if (rtt_ms) this->_replies.fetch_add(1, std::memory_order_relaxed);
+
+		target.samples.add(rtt_ms, error_ms);
+		target.statistics.store(target.samples.compute());
+	}
+
+	void PingService::_startReceive(Channel& channel)
+	{
+#if defined(_WIN32)
+		channel.socket.async_receive_from(asio::buffer(channel.reply_buffers[0]), channel.reply_sources[0],
+			[this, &channel](const asio::error_code& error, std::size_t length) { this->_handleReceive(channel, error, length); });
+#else
+		/* recvmmsg ourselves, asio drops the timestamp cmsgs. icmp errors wake it up too */
+		auto handler = [this, &channel](const asio::error_code& error) { this->_handleReadable(channel, error); };
+
+		if (channel.unreachable)
+			channel.udp.async_wait(asio::ip::udp::socket::wait_read, handler);
+		else
+			channel.socket.async_wait(icmp::socket::wait_read, handler);
+#endif
+	}
+
+#if defined(_WIN32)
+	void PingService::_handleReceive(Channel& channel, const asio::error_code& error, std::size_t length)
+	{
+		if (error == asio::error::operation_aborted || !channel.socket.is_open()) return;
+
+		if (!error) this->_handleReply(channel, channel.reply_sources[0], std::span(channel.reply_buffers[0].data(), length), std::nullopt);
+
+		this->_startReceive(channel);
+	}
+#else
+	int PingService::_receiveBatch(Channel& channel, int flags)
+	{
+		/* the kernel writes back lengths and flags, set everything again */
+		for (size_t i = 0; i < __receive_batch; i++)
+		{
+			channel.receive_iovecs[i] = { channel.reply_buffers[i].data(), __receive_size };
+
+			auto& header = channel.receive_messages[i].msg_hdr;
+			header = {};
+			header.msg_name = channel.reply_sources[i].data();
+			header.msg_namelen = static_cast<socklen_t>(channel.reply_sources[i].capacity());
+			header.msg_iov = &channel.receive_iovecs[i];
+			header.msg_iovlen = 1;
+			header.msg_control = channel.control_buffers[i].data();
+			header.msg_controllen = __control_size;
+		}
+
+		return recvmmsg(channel.unreachable ? channel.udp.native_handle() : channel.socket.native_handle(), channel.receive_messages.data(), __receive_batch, flags | MSG_DONTWAIT, nullptr);
+	}
+
+	void PingService::_handleReadable(Channel& channel, const asio::error_code& error)
+	{
+		if (error == asio::error::operation_aborted || !channel.isOpen()) return;
+
+		/* a reply can't beat its own transmit stamp into the queues */
+		if (channel.tx_timestamps || channel.recverr) this->_drainErrorQueue(channel);
+
+		for (;;)
+		{
+			const int received = this->_receiveBatch(channel, 0);
+			if (received <= 0) break;
+
+			/* nothing should answer on a closed port. whatever does is drained and dropped */
+			if (channel.unreachable) continue;
+
+			for (int i = 0; i < received; i++)
+			{
+				auto& header = channel.receive_messages[i].msg_hdr;
+				channel.reply_sources[i].resize(header.msg_namelen);
+
+				const auto received_ns = channel.rx_timestamps ? kernelTimestamp(header) : std::nullopt;
+				this->_handleReply(channel, channel.reply_sources[i], std::span(channel.reply_buffers[i].data(), channel.receive_messages[i].msg_len), received_ns);
+			}
+
+			if (received < static_cast<int>(__receive_batch)) break;
+		}
+
+		this->_startReceive(channel);
+	}
+
+	void PingService::_drainErrorQueue(Channel& channel)
+	{
+		for (;;)
+		{
+			const int received = this->_receiveBatch(channel, MSG_ERRQUEUE);
+			if (received <= 0) break;
+
+			for (int i = 0; i < received; i++)
+			{
+				auto& header = channel.receive_messages[i].msg_hdr;
+
+				const auto extended = extendedError(header);
+				if (!extended) continue;
+
+				/* the receive stamp of the icmp error, who sent it, and the probe it quotes */
+				if (extended->ee_origin == SO_EE_ORIGIN_ICMP || extended->ee_origin == SO_EE_ORIGIN_ICMP6)
+				{
+					const auto offender = errorOffender(header);
+					if (!offender) continue;
+
+					channel.reply_sources[i].resize(header.msg_namelen);
+
+					const auto received_ns = channel.rx_timestamps ? kernelTimestamp(header) : std::nullopt;
+					this->_handleError(channel, channel.reply_sources[i], std::span(channel.reply_buffers[i].data(), channel.receive_messages[i].msg_len), extended.value(), offender.value(), received_ns);
+					continue;
+				}
+
+				const auto sent_ns = kernelTimestamp(header);
+				if (!sent_ns || extended->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) continue;
+
+				const auto& target = this->_slots[channel.tx_slots[extended->ee_data % __max_targets]];
+
+				/* a stale key, or our send count drifted from the kernel's */
+				if (!target || !target->waiting || target->tx_key != extended->ee_data) continue;
+				if (sent_ns.value() < target->sent_ns - target->sent_error_ns) continue;
+
+				target->kernel_sent_ns = sent_ns;
+			}
+
+			if (received < static_cast<int>(__receive_batch)) break;
+		}
+	}
+
+	void PingService::_handleError(Channel& channel, const icmp::endpoint& destination, std::span<const uint8_t> payload, const sock_extended_err& extended, const asio::ip::address& offender, std::optional<int64_t> received_ns)
+	{
+		/* the payload is our echo request, on its own or inside the datagram. its sequence tells a late error apart */
+		const bool quoted = payload.size() >= 8;
+		const uint16_t sequence = quoted ? static_cast<uint16_t>((payload[6] << 8) | payload[7]) : 0;
+
+		/* unreachable probes find their slot by port, ping sockets need the sequence */
+		size_t slot;
+		if (channel.unreachable)
+		{
+			slot = static_cast<size_t>(destination.port() - __unreachable_port);
+			if (destination.port() < __unreachable_port || slot >= __max_targets) return;
+		}
+		else
+		{
+			if (!quoted) return;
+			slot = sequence & (__max_targets - 1);
+		}
+
+		const auto& target = this->_slots[slot];
+		if (!target || !target->waiting || &this->_channel(*target) != &channel
+			|| destination.address() != target->destination.address()) return;
+
+		if (quoted && sequence != target->sequence) return;
+
+		/* a ttl limited probe died on the way, or an unreachable probe got to its host. anything else came from a firewall in the way */
+		const bool time_exceeded = extended.ee_type == (channel.v6 ? ErrorType::time_exceeded_v6 : ErrorType::time_exceeded_v4);
+		const bool port_unreachable = channel.v6
+			? extended.ee_type == ErrorType::unreachable_v6 && extended.ee_code == ErrorType::port_unreachable_v6
+			: extended.ee_type == ErrorType::unreachable_v4 && extended.ee_code == ErrorType::port_unreachable_v4;
+
+		if (!(time_exceeded && target->ttl) && !(port_unreachable && channel.unreachable)) return;
+
+		/* a local reject rule or a router on the path answers for the host with its own address. only the host's own reply is timed */
+		if (!target->ttl && offender != target->destination.address()) return;
+
+		this->_complete(*target, received_ns, offender);
+	}
+#endif
+
+	void PingService::_handleReply(Channel& channel, const icmp::endpoint& source, std::span<const uint8_t> data, std::optional<int64_t> received_ns)
+	{
+		/* only raw ipv4 sockets see the ip header */
+		const bool ipv4_header = !channel.datagram && !channel.v6;
+
+		const auto reply = parseEchoReply(data, ipv4_header);
+		if (!reply) return;
+
+		/* raw sockets get every icmp error too. the ones about our ttl limited probes are answers from the routers on the way */
+		if (reply->type == (channel.v6 ? ErrorType::time_exceeded_v6 : ErrorType::time_exceeded_v4) && !channel.datagram)
+		{
+			const auto quoted = parseQuotedEcho(data, ipv4_header, channel.v6);
+			if (!quoted || quoted->identifier != this->_identifier) return;
+
+			const auto& target = this->_slots[quoted->sequence & (__max_targets - 1)];
+			if (!target || !target->waiting || !target->ttl || target->sequence != quoted->sequence) return;
+
+			this->_complete(*target, received_ns, source.address());
+			return;
+		}
+
+		/* the kernel already matched the identifier of datagram sockets */
+		if (reply->type != (channel.v6 ? EchoType::reply_v6 : EchoType::reply_v4)
+			|| (!channel.datagram && reply->identifier != this->_identifier)) return;
+
+		const auto& target = this->_slots[reply->sequence & (__max_targets - 1)];
+
+		if (!target || !target->waiting || target->sequence != reply->sequence
+			|| source.address() != target->destination.address()) return;
+
+		this->_complete(*target, received_ns, source.address());
+	}
+
+	void PingService::_complete(Target& target, std::optional<int64_t> received_ns, const asio::ip::address& responder)
+	{
+		/* too late, the next tick counts it lost */
+		if (chrono::steady_clock::now() - target.time_sent > __timeout) return;
+
+		target.waiting = false;
+		target.unanswered = 0;
+
+		Responder stored { .v6 = responder.is_v6(), .known = true };
+		if (responder.is_v6())
+			stored.bytes = responder.to_v6().to_bytes();
+		else
+			std::ranges::copy(responder.to_v4().to_bytes(), stored.bytes.begin());
+		target.responder.store(stored);
+
+		/* both ends from the kernel if we can. otherwise the send call brackets the transmit */
+		const int64_t sent_ns = target.kernel_sent_ns.value_or(target.sent_ns);
+		const int64_t error_ns = target.kernel_sent_ns ? 0 : target.sent_error_ns;
+		const int64_t rtt_ns = received_ns.value_or(0) - sent_ns;
+
+		/* the realtime clock can be stepped, then this probe is timed like on windows */
+		if (received_ns && rtt_ns >= 0 && rtt_ns < chrono::duration_cast<chrono::nanoseconds>(__timeout).count())
+		{
+			this->_record(target, rtt_ns / 1e6f, error_ns / 1e6f);
+		}
+		else
+		{
+			const chrono::duration<float, std::milli> elapsed = chrono::steady_clock::now() - target.time_sent;
+			this->_record(target, elapsed.count(), std::nullopt);
+		}
+	}
+}
@@ -0,0 +1,399 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "asio/asio.h"
+#include "Packet.h"
+#include "Statistics.h"
+
+#if !defined(_WIN32)
+#include <linux/errqueue.h>
+#include <sys/socket.h>
+#endif
+
+/* no pch, shared by the windows and linux builds */
+
+namespace util::ping {
+
+	using TargetId = uint32_t;
+
+	enum class Method
+	{
+		icmp,
+
+		/* time to a syn-ack, or to the rst of a closed port */
+		tcp,
+
+		/* time to any datagram back, or to the port unreachable of a closed port */
+		udp,
+
+		/*
+			a datagram to a closed port, timed to the port unreachable of the host itself
+			takes the path and the firewalls game traffic takes, and needs no privileges.
+			batched and kernel timed like icmp on linux, a socket per target like udp elsewhere
+		*/
+		unreachable,
+
+		/* icmp until __fallback_probes go unanswered in a row, or if there is no icmp socket. tcp from then on */
+		automatic,
+	};
+
+	/* how a target is probed */
+	struct Probe
+	{
+		Method method { Method::icmp };
+
+		/* tcp, udp and the fallback of automatic. unreachable picks its own */
+		uint16_t port { 443 };
+
+		/*
+			hops the probe may take, 0 for the os default. icmp and unreachable only, and only icmp on windows
+			a probe that runs out is answered by the router it died at, see getResponder
+		*/
+		uint8_t ttl { 0 };
+
+		/* probed even while the service is paused. for the few targets that can't wait for the game to close */
+		bool while_paused { false };
+	};
+
+	/* totals since the service started */
+	struct Counters
+	{
+		/* probes sent, and how many of them were answered in time */
+		uint64_t probes { 0 };
+		uint64_t replies { 0 };
+	};
+
+	/*
+		one io_context and one icmp socket per address family for every ping target
+		replies are parsed once and routed to their probe by echo sequence
+		thread count is fixed at construction, not per target
+		once targets are added, sending and receiving don't allocate
+
+		targets due together are probed on the same tick, so their rtts are comparable.
+		on linux a tick is one sendmmsg per family, and replies are drained with recvmmsg
+
+		one timer schedules every target and only wakes when one is due.
+		a new target is probed quickly until it has a number, then less often the steadier it is.
+		nothing is sent while paused except to targets added while_paused, and a network change starts every target over
+
+		prefers an unprivileged icmp datagram socket (linux, net.ipv4.ping_group_range)
+		and falls back to a raw socket, which needs admin/root
+
+		on linux rtts come from kernel timestamps, so a busy box doesn't add its scheduling delay.
+		elsewhere they're taken when the handler runs
+
+		networks that drop icmp can be probed with a tcp connect or a udp datagram instead.
+		each of those targets has its own socket, which needs no privileges
+
+		a batched probe can be ttl limited. the time exceeded of the router it dies at
+		answers it like a reply would, so every hop of a path is timed in one tick
+	*/
+	class PingService
+	{
+		/* consts */
+		private:
+			static constexpr size_t __default_threads { 1 };
+
+			/* a target's first probes come this often, so it converges quickly. nothing is probed more often */
+			static constexpr auto __fast_interval { chrono::seconds(1) };
+			static constexpr uint32_t __fast_probes { 4 };
+
+			/* a target that isn't steady is probed this often. a steady one backs off, doubling up to the max */
+			static constexpr auto __interval { chrono::seconds(4) };
+			static constexpr auto __max_interval { chrono::seconds(16) };
+
+			/* steady: the last rtt is this close to the median, or within twice the jitter */
+			static constexpr float __steady_ms { 1.0f };
+
+			/* a probe without a reply by then is lost. a target with one still out sits out the tick */
+			static constexpr auto __timeout { chrono::seconds(2) };
+
+			/* the low bits of an echo sequence are the target's slot, the rest count its probes */
+			static constexpr unsigned __slot_bits { 10 };
+			static constexpr size_t __max_targets { size_t(1) << __slot_bits };
+
+			/* one ethernet frame. echo replies are far smaller, anything longer is cut off */
+			static constexpr size_t __receive_size { 1500 };
+
+			/* a burst of replies and transmit stamps all land before we read them. the os caps it (net.core.rmem_max) */
+			static constexpr int __receive_buffer { int(__max_targets) * 2 * 2048 };
+
+			/* messages per recvmmsg */
+			static constexpr size_t __receive_batch { 32 };
+
+			/* room for the timestamp and extended error cmsgs */
+			static constexpr size_t __control_size { 256 };
+
+			/* unanswered icmp probes in a row before an automatic target switches to tcp */
+			static constexpr uint32_t __fallback_probes { 3 };
+
+			/* whatever comes back on a udp target's socket is only waited for, not read */
+			static constexpr size_t __datagram_size { 64 };
+
+			/* unreachable targets probe this plus their slot, where traceroute probes. nothing listens there */
+			static constexpr uint16_t __unreachable_port { 33434 };
+
+			/* hosts rate limit their icmp errors. past this many per tick the rest go first on the next one */
+			static constexpr size_t __unreachable_burst { 128 };
+
+		public:
+			PingService(size_t threads = __default_threads);
+			~PingService();
+
+			/* start pinging an ipv4 or ipv6 address. throws if it can't be resolved, there is no icmp socket for its family, or no free slot */
+			TargetId add(const std::string& address, Probe probe = {});
+			void remove(TargetId id);
+
+			/* what the target is probed with right now. automatic targets report icmp or tcp */
+			std::optional<Method> getMethod(TargetId id);
+
+			/* who answered the last probe. the destination, or the router a ttl limited probe died at */
+			std::optional<asio::ip::address> getResponder(TargetId id);
+
+			/* stop sending, ex. while the window is hidden or the game is running. in-flight probes don't count as lost */
+			void setPaused(bool paused);
+			bool isPaused() const { return this->_paused; }
+
+			/* the network changed. forget every target's samples and probe them all now */
+			void reprobe();
+
+			/* last rtt in ms. nullopt before the first probe completes, -1 on timeout */
+			std::optional<int> getPing(TargetId id);
+
+			/* recent samples of a target. doesn't block on, or allocate in, the ping thread */
+			std::optional<Statistics> getStatistics(TargetId id);
+
+			/* pinging works without admin/root */
+			bool isUnprivileged() const { return this->_v4.datagram; }
+
+			/* there is an icmp socket for this family */
+			bool isAvailable(bool v6) const { return (v6 ? this->_v6 : this->_v4).isOpen(); }
+
+			/* for benchmarks, ex. cpu per probe */
+			Counters getCounters() const { return { this->_probes.load(std::memory_order_relaxed), this->_replies.load(std::memory_order_relaxed) }; }
+
+		private:
+			/* an address the seqlock can copy */
+			struct Responder
+			{
+				std::array<uint8_t, 16> bytes {};
+				bool v6 { false };
+				bool known { false };
+			};
+
+			struct Target
+			{
+				Target(asio::strand<asio::io_context::executor_type>& strand, icmp::endpoint destination, size_t slot, EchoRequest request, Probe probe) :
+					destination(destination), v6(destination.address().is_v6()), slot(slot), automatic(probe.method == Method::automatic), port(probe.port), ttl(probe.ttl), while_paused(probe.while_paused),
+					method(probe.method == Method::automatic ? Method::icmp : probe.method), request(request), tcp(strand), udp(strand) {}
+
+				const icmp::endpoint destination;
+				const bool v6;
+
+				/* index into _slots */
+				const size_t slot;
+
+				const bool automatic;
+				const uint16_t port;
+				const uint8_t ttl;
+				const bool while_paused;
+
+				/* never automatic. written on the strand, read by the ui */
+				std::atomic<Method> method;
+
+				/* automatic only, icmp probes lost in a row */
+				uint32_t unanswered { 0 };
+
+				/* when the next probe is due, and how far apart they are now */
+				chrono::steady_clock::time_point next_probe;
+				chrono::steady_clock::duration interval { __interval };
+				uint32_t fast_probes { __fast_probes };
+
+				/* sequence of the last probe, unique across the service */
+				uint16_t sequence { 0 };
+				uint16_t round { 0 };
+
+				EchoRequest request;
+
+				/* the last probe is neither answered nor lost yet */
+				bool waiting { false };
+				chrono::steady_clock::time_point time_sent;
+
+				/* realtime clock like kernel timestamps. middle of the send call, and half its length */
+				int64_t sent_ns { 0 };
+				int64_t sent_error_ns { 0 };
+
+				/* from the error queue, if the socket reports transmit timestamps */
+				std::optional<int64_t> kernel_sent_ns;
+				uint32_t tx_key { 0 };
+
+				/* tcp opens a new socket per probe, udp keeps one connected for good. so does unreachable on windows */
+				asio::ip::tcp::socket tcp;
+				asio::ip::udp::socket udp;
+				std::array<uint8_t, __datagram_size> datagram_buffer;
+
+				/* strand only */
+				SampleRing samples;
+
+				/* written on the strand, read by the ui */
+				Seqlock<Statistics> statistics;
+				Seqlock<Responder> responder;
+			};
+
+			/* a socket and its receive loop */
+			struct Channel
+			{
+				Channel(asio::strand<asio::io_context::executor_type>& strand, bool v6, bool unreachable) :
+					socket(strand), udp(strand), v6(v6), unreachable(unreachable) {}
+
+				/* the udp socket on unreachable channels, the icmp one otherwise */
+				icmp::socket socket;
+				asio::ip::udp::socket udp;
+
+				const bool v6;
+				const bool unreachable;
+
+				bool isOpen() const { return this->unreachable ? this->udp.is_open() : this->socket.is_open(); }
+
+				/*
+					datagram sockets get replies without the ip header, and only their own
+					the kernel picks their echo identifier, raw sockets use _identifier
+					raw icmpv6 sockets never see the ip header either
+				*/
+				bool datagram { false };
+
+				/* windows only uses the first */
+				std::array<std::array<uint8_t, __receive_size>, __receive_batch> reply_buffers;
+				std::array<icmp::endpoint, __receive_batch> reply_sources;
+
+				/* linux only. kernel timestamps on receive, and on transmit through the error queue */
+				bool rx_timestamps { false };
+				bool tx_timestamps { false };
+
+				/* linux only. icmp errors about our probes come through the error queue */
+				bool recverr { false };
+
+				/* transmit timestamps are keyed by a count of the socket's sends. key -> slot */
+				uint32_t tx_key { 0 };
+				std::array<uint16_t, __max_targets> tx_slots {};
+
+				/* targets of the current tick. everything below is sized for every slot up front */
+				std::vector<Target*> burst;
+
+#if !defined(_WIN32)
+				std::array<std::array<uint8_t, __control_size>, __receive_batch> control_buffers;
+				std::array<iovec, __receive_batch> receive_iovecs;
+				std::array<mmsghdr, __receive_batch> receive_messages;
+
+				std::vector<iovec> send_iovecs;
+				std::vector<mmsghdr> send_messages;
+
+				/* a ttl for each ttl limited probe */
+				std::vector<std::array<uint8_t, CMSG_SPACE(sizeof(int))>> send_controls;
+#else
+				/* restored after each ttl limited probe */
+				int default_hops { 128 };
+#endif
+			};
+
+			/* strand only */
+			void _open(Channel& channel);
+
+			/* probes every target that's due, then sleeps until the next one is */
+			void _tick();
+			void _schedule(chrono::steady_clock::time_point now);
+
+			/* not paused, or probed anyway */
+			bool _isProbed(const Target& target) const { return this->_ticking || target.while_paused; }
+
+			/* how long until the target's next probe, from how its last ones went */
+			void _pace(Target& target, chrono::steady_clock::time_point now);
+
+			/* forget an in-flight probe without counting it lost */
+			void _abandon(Target& target);
+
+			/* where the target's batched probes go */
+			Channel& _channel(const Target& target);
+
+			void _send(Channel& channel, std::span<Target* const> targets);
+			void _connect(const std::shared_ptr<Target>& target);
+			void _sendDatagram(const std::shared_ptr<Target>& target);
+			void _startDatagramReceive(const std::shared_ptr<Target>& target);
+			void _handleConnect(Target& target, uint16_t round, const asio::error_code& error);
+			void _handleDatagram(const std::shared_ptr<Target>& target, const asio::error_code& error);
+			void _record(Target& target, std::optional<float> rtt_ms, std::optional<float> error_ms);
+			void _startReceive(Channel& channel);
+
+			/* received_ns is a kernel timestamp, nullopt to time the reply now */
+			void _handleReply(Channel& channel, const icmp::endpoint& source, std::span<const uint8_t> data, std::optional<int64_t> received_ns);
+
+			/* records the rtt of a batched probe that was answered, and by whom */
+			void _complete(Target& target, std::optional<int64_t> received_ns, const asio::ip::address& responder);
+
+#if defined(_WIN32)
+			void _handleReceive(Channel& channel, const asio::error_code& error, std::size_t length);
+#else
+			void _openUnreachable(Channel& channel);
+			void _enableTimestamps(Channel& channel, int fd);
+			void _enableErrors(Channel& channel, int fd);
+			void _handleReadable(Channel& channel, const asio::error_code& error);
+
+			/* transmit timestamps, and icmp errors about our probes */
+			void _drainErrorQueue(Channel& channel);
+			void _handleError(Channel& channel, const icmp::endpoint& destination, std::span<const uint8_t> payload, const sock_extended_err& extended, const asio::ip::address& offender, std::optional<int64_t> received_ns);
+
+			/* one recvmmsg into the receive messages, returns how many arrived */
+			int _receiveBatch(Channel& channel, int flags);
+#endif
+
+			asio::io_context _io_context;
+			asio::executor_work_guard<asio::io_context::executor_type> _work;
+			asio::strand<asio::io_context::executor_type> _strand;
+			std::vector<std::future<void>> _threads;
+
+			/* not open if neither kind of socket is allowed, or the host has no ipv6 */
+			Channel _v4;
+			Channel _v6;
+
+			/* linux only */
+			Channel _v4_unreachable;
+			Channel _v6_unreachable;
+
+			uint16_t _identifier { 0 };
+
+			/* every target's probe goes out on this */
+			steady_timer _tick_timer;
+
+			/* set by the caller, _ticking follows it on the strand */
+			std::atomic<bool> _paused { false };
+			bool _ticking { true };
+
+			/* written on the strand */
+			std::atomic<uint64_t> _probes { 0 };
+			std::atomic<uint64_t> _replies { 0 };
+
+			/* strand only. the slot a tick starts at, so targets held back by a rate limit go first next time */
+			size_t _tick_start { 0 };
+
+			/* strand only. echo sequence slot bits -> target */
+			std::array<std::shared_ptr<Target>, __max_targets> _slots;
+
+			std::mutex _targets_mutex;
+			TargetId _next_id { 0 };
+			std::map<TargetId, std::shared_ptr<Target>> _targets;
+
+			/* a slot is freed once the strand has let go of its target */
+			std::array<bool, __max_targets> _slots_taken {};
+	};
+}
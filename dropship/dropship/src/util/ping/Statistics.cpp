@@ -0,0 +1,83 @@
+#include "Statistics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace util::ping {
+
+	void SampleRing::add(std::optional<float> rtt_ms, std::optional<float> error_ms)
+	{
+		this->_samples[this->_next] = rtt_ms ? std::max(rtt_ms.value(), 0.0f) : -1.0f;
+		this->_errors[this->_next] = error_ms ? std::max(error_ms.value(), 0.0f) : -1.0f;
+		this->_next = (this->_next + 1) % __capacity;
+		this->_count = std::min(this->_count + 1, __capacity);
+	}
+
+	Statistics SampleRing::compute() const
+	{
+		Statistics result;
+		result.samples = static_cast<uint32_t>(this->_count);
+		if (this->_count == 0) return result;
+
+		/* oldest first */
+		const size_t first = (this->_next + __capacity - this->_count) % __capacity;
+
+		std::array<float, __capacity> replies;
+		size_t count = 0;
+
+		float sum = 0.0f;
+		float jitter_sum = 0.0f;
+		size_t jitter_count = 0;
+		float previous = -1.0f;
+
+		float error = 0.0f;
+		bool error_known = true;
+
+		for (size_t i = 0; i < this->_count; i++)
+		{
+			const float sample = this->_samples[(first + i) % __capacity];
+
+			if (sample < 0.0f)
+			{
+				result.lost++;
+				continue;
+			}
+
+			replies[count++] = sample;
+
+			/* worst of the window */
+			const float sample_error = this->_errors[(first + i) % __capacity];
+			error_known = error_known && sample_error >= 0.0f;
+			error = std::max(error, sample_error);
+			sum += sample;
+
+			if (previous >= 0.0f)
+			{
+				jitter_sum += std::fabs(sample - previous);
+				jitter_count++;
+			}
+			previous = sample;
+		}
+
+		result.last = this->_samples[(this->_next + __capacity - 1) % __capacity];
+		if (count == 0) return result;
+
+		result.mean = sum / count;
+		if (error_known) result.error = error;
+		result.jitter = jitter_count ? jitter_sum / jitter_count : 0.0f;
+		result.min = *std::min_element(replies.begin(), replies.begin() + count);
+
+		/* nearest rank */
+		auto percentile = [&](float p)
+		{
+			const size_t rank = std::min(count - 1, static_cast<size_t>(std::ceil(p * count)) - 1);
+			std::nth_element(replies.begin(), replies.begin() + rank, replies.begin() + count);
+			return replies[rank];
+		};
+
+		result.p50 = percentile(0.50f);
+		result.p95 = percentile(0.95f);
+
+		return result;
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+
+/* no pch, shared by the windows and linux builds */
+
+namespace util::ping {
+
+	/* summary of a target's recent samples, in milliseconds */
+	struct Statistics
+	{
+		/* probes in the window, and how many got no reply */
+		uint32_t samples { 0 };
+		uint32_t lost { 0 };
+
+		/* last rtt, -1 if the last probe was lost */
+		float last { -1.0f };
+
+		float min { 0.0f };
+		float mean { 0.0f };
+		float p50 { 0.0f };
+		float p95 { 0.0f };
+
+		/* mean difference between consecutive replies */
+		float jitter { 0.0f };
+
+		/* the rtts are within this much of the truth. nullopt if some came from userspace clocks and nobody knows */
+		std::optional<float> error;
+
+		float loss() const { return this->samples ? static_cast<float>(this->lost) / this->samples : 0.0f; }
+
+		/* at least one reply in the window */
+		bool valid() const { return this->samples > this->lost; }
+	};
+
+	/* last __capacity probes of one target. single writer, no allocations */
+	class SampleRing
+	{
+		/* consts */
+		public:
+			static constexpr size_t __capacity { 32 };
+
+		public:
+			/* nullopt for a lost probe. error_ms bounds how far rtt_ms may be off, if known */
+			void add(std::optional<float> rtt_ms, std::optional<float> error_ms = std::nullopt);
+
+			Statistics compute() const;
+
+		private:
+			/* negative for lost */
+			std::array<float, __capacity> _samples {};
+
+			/* negative for unknown */
+			std::array<float, __capacity> _errors {};
+			size_t _next { 0 };
+			size_t _count { 0 };
+	};
+
+	/*
+		publishes a trivially copyable value from one writer to any number of readers
+		readers retry while a write is in progress, nobody blocks or allocates
+	*/
+	template<typename T>
+	class Seqlock
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+
+		/* consts */
+		private:
+			static constexpr size_t __words { (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t) };
+
+		public:
+			Seqlock() { this->store(T {}); }
+
+			/* one writer at a time */
+			void store(const T& value)
+			{
+				uint32_t words[__words] {};
+				std::memcpy(words, &value, sizeof(T));
+
+				const auto sequence = this->_sequence.load(std::memory_order_relaxed);
+				this->_sequence.store(sequence + 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+
+				for (size_t i = 0; i < __words; i++)
+				{
+					this->_words[i].store(words[i], std::memory_order_relaxed);
+				}
+
+				this->_sequence.store(sequence + 2, std::memory_order_release);
+			}
+
+			T load() const
+			{
+				uint32_t words[__words];
+				uint32_t before, after;
+
+				do {
+					before = this->_sequence.load(std::memory_order_acquire);
+
+					for (size_t i = 0; i < __words; i++)
+					{
+						words[i] = this->_words[i].load(std::memory_order_relaxed);
+					}
+
+					std::atomic_thread_fence(std::memory_order_acquire);
+					after = this->_sequence.load(std::memory_order_relaxed);
+				} while ((before & 1) || before != after);
+
+				T value;
+				std::memcpy(&value, words, sizeof(T));
+				return value;
+			}
+
+		private:
+			/* odd while a write is in progress */
+			std::atomic<uint32_t> _sequence { 0 };
+			std::array<std::atomic<uint32_t>, __words> _words {};
+	};
+}
@@ -0,0 +1,65 @@
+#include "Traceroute.h"
+
+namespace util::ping {
+
+	Traceroute::Traceroute(PingService& ping_service, const std::string& address, Method method) :
+		_ping_service(ping_service),
+		_destination(asio::ip::make_address(address))
+	{
+		try {
+			for (uint8_t ttl = 1; ttl <= __max_hops; ttl++)
+			{
+				this->_targets.push_back(this->_ping_service.add(address, { .method = method, .ttl = ttl }));
+			}
+		}
+		catch (...) {
+			for (auto target : this->_targets)
+			{
+				this->_ping_service.remove(target);
+			}
+			throw;
+		}
+	}
+
+	Traceroute::~Traceroute()
+	{
+		for (auto target : this->_targets)
+		{
+			this->_ping_service.remove(target);
+		}
+	}
+
+	std::vector<Hop> Traceroute::getHops()
+	{
+		std::vector<Hop> hops;
+
+		for (size_t i = 0; i < this->_targets.size(); i++)
+		{
+			Hop hop;
+			hop.ttl = static_cast<uint8_t>(i + 1);
+
+			const auto statistics = this->_ping_service.getStatistics(this->_targets[i]);
+			if (statistics) hop.statistics = statistics.value();
+
+			const auto responder = this->_ping_service.getResponder(this->_targets[i]);
+			if (responder) hop.address = responder->to_string();
+
+			hops.push_back(hop);
+
+			/* every probe that gets this far is answered by the destination too, stop the ones past it */
+			if (responder == this->_destination)
+			{
+				for (size_t j = i + 1; j < this->_targets.size(); j++)
+				{
+					this->_ping_service.remove(this->_targets[j]);
+				}
+
+				this->_targets.resize(i + 1);
+				this->_complete = true;
+				break;
+			}
+		}
+
+		return hops;
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "PingService.h"
+
+/* no pch, shared by the windows and linux builds */
+
+namespace util::ping {
+
+	/* one router on the way, or the destination itself */
+	struct Hop
+	{
+		uint8_t ttl { 0 };
+
+		/* nullopt until something at this distance answered */
+		std::optional<std::string> address;
+
+		Statistics statistics;
+	};
+
+	/*
+		the path to an address, every hop probed at once
+		a ttl limited probe per hop goes out in the same tick, so a whole trace takes one probe timeout, not one per hop.
+		hops keep being probed on the ping service's schedule, so their rtt and loss fill in like any target's.
+		not thread safe, use it from one thread
+	*/
+	class Traceroute
+	{
+		/* consts */
+		private:
+			static constexpr uint8_t __max_hops { 30 };
+
+		public:
+			/* the ping service must outlive this. throws if address isn't an ip, or the service refuses the probes */
+			Traceroute(PingService& ping_service, const std::string& address, Method method = Method::icmp);
+			~Traceroute();
+
+			/* closest first, up to the first hop the destination answered. hops past it are stopped */
+			std::vector<Hop> getHops();
+
+			/* the destination answered one of the probes */
+			bool isComplete() const { return this->_complete; }
+
+		private:
+			PingService& _ping_service;
+			asio::ip::address _destination;
+
+			/* index + 1 is the ttl */
+			std::vector<TargetId> _targets;
+
+			bool _complete { false };
+	};
+}
@@ -11,6 +11,7 @@ namespace util::win_network {
 
         {
             int total_netcount = 0;
+            std::set<std::wstring> network_ids;
 
             long total_connectedNetworkProfileBitmask = 0x0;
             long total_networkProfilesEnabledInFirewallBitmask = 0x0;
@@ -41,6 +42,14 @@ namespace util::win_network {
 
                 total_netcount ++;
 
+                /* which network, not just how many */
+                GUID network_id;
+                wchar_t network_id_text[40];
+                if (SUCCEEDED(pINetwork->GetNetworkId(&network_id)) && StringFromGUID2(network_id, network_id_text, 40) > 0)
+                {
+                    network_ids.insert(network_id_text);
+                }
+
                 /*
                     CComBSTR
                     CComBSTR
@@ -100,6 +109,7 @@ namespace util::win_network {
                 .network_profiles_connected = total_connectedNetworkProfileBitmask,
                 .firewall_profiles_enabled = total_networkProfilesEnabledInFirewallBitmask,
                 .connected_networks_are_enabled_in_firewall = connected_networks_are_enabled_in_firewall,
+                .network_ids = std::move(network_ids),
             };
 
             /*if (this->networkInfo.connected_networks == 0 && ImGui::GetCurrentContext() != nullptr)
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <netlistmgr.h> // INetworkListManager
+#include <set>
+#include <string>
 //#include <icftypes.h> // NET_FW_PROFILE_TYPE2_
 
 #include "util/win/win_net_fw.h"
@@ -21,11 +23,16 @@ namespace util::win_network {
 		long network_profiles_connected;
 		long firewall_profiles_enabled;
 
+		// network list manager ids of the connected networks. another network of the same shape has another id
+		std::set<std::wstring> network_ids;
+
 		// is there a mismatch? ex. are they connected to a private network, but the private firewall profile is disabled?
 		bool connected_networks_are_enabled_in_firewall;
 
 		// imgui timer;
 		//double _updated_at;
+
+		bool operator==(const NetworkInformation&) const = default;
 	};
 
 	NetworkInformation queryNetwork();